@@ -0,0 +1,287 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+
+// compact accelerometer trace format
+// NOTE hardware independent: the sink is injected, the decoder builds on host as well
+//
+// stream: header, then records
+//	header: 'A' 'T' version(1) tick_us(u32 LE)
+//	record: tag [7:6] kind, [5] status byte follows, [4:0] time delta in ticks (31: varint follows)
+//		KIND_DELTA4: 2 bytes, zigzag 4 bit delta per axis (x, y, z from bit 0), 4 bits unused
+//		KIND_DELTA8: 3 bytes, zigzag 8 bit delta per axis
+//		KIND_KEY:    4 bytes LE, 3 x 10 bit two's complement (x, y, z from bit 0)
+//	deltas are against the previous sample, a key frame is forced every `key_interval` samples
+//	timestamps decode relative to the first record
+namespace accl_trace {
+static const constexpr uint8_t
+	version = 1,
+	header_len = 7;
+
+enum kind_e : uint8_t {
+	KIND_DELTA4 = 0b00,
+	KIND_DELTA8 = 0b01,
+	KIND_KEY    = 0b10,
+	KIND_RESERVED = 0b11
+};
+
+static const constexpr uint8_t
+	tag_status = 1 << 5,
+	tag_dt_mask = 0x1F,
+	tag_dt_varint = 0x1F;
+
+struct sample_s {
+	uint32_t t;		// ticks
+	int16_t x, y, z;
+	bool has_status;
+	uint8_t status;	// e.g. raw BMA250 interrupt status (0x09)
+};
+
+constexpr uint8_t zigzag(int16_t v) { return (uint8_t)((v << 1) ^ (v >> 15)); }
+constexpr int16_t unzigzag(uint8_t v) { return (int16_t)((v >> 1) ^ -(int16_t)(v & 1)); }
+
+constexpr int16_t sign_extend10(uint32_t v) {
+	return (int16_t)((int32_t)(v << 22) >> 22);
+}
+
+class encoder {
+public:
+	using sink_fn_t = void (const uint8_t *, std::size_t, void *);
+
+	static const constexpr std::size_t
+		buf_cap = 64,
+		key_interval = 64;
+
+	struct stats_s {
+		uint32_t n_samples = 0;
+		uint32_t n_bytes = 0;
+		uint32_t n_keys = 0;
+	};
+
+protected:
+	sink_fn_t *sink_f;
+	void *sink_data;
+
+	uint8_t buf[buf_cap];
+	std::size_t len = 0;
+
+	bool has_prev = false;
+	uint32_t t_prev = 0;
+	int16_t prev[3] = {};
+	std::size_t n_since_key = 0;
+
+	struct stats_s stats_ = {};
+
+	void put(uint8_t b) {
+		this->buf[this->len++] = b;
+	}
+
+	void put_varint(uint32_t v) {
+		while (v >= 0x80) {
+			this->put((uint8_t)(v | 0x80));
+			v >>= 7;
+		}
+		this->put((uint8_t)v);
+	}
+
+public:
+	encoder(sink_fn_t *sink_f, void *sink_data = nullptr)
+		: sink_f(sink_f), sink_data(sink_data) {}
+
+	// start a stream, `tick_us` is the unit of the timestamps
+	void begin(uint32_t tick_us) {
+		this->flush();
+		this->has_prev = false;
+
+		this->put('A');
+		this->put('T');
+		this->put(version);
+		for (unsigned i = 0; i < 4; i++)
+			this->put((uint8_t)(tick_us >> (8 * i)));
+	}
+
+	// NOTE 10 bit samples, at most 11 bytes per record
+	void push(uint32_t t, int16_t x, int16_t y, int16_t z, bool has_status = false, uint8_t status = 0) {
+		// worst case: tag, varint, key frame, status
+		if (this->len + 1 + 5 + 4 + 1 > buf_cap)
+			this->flush();
+
+		const int16_t cur[3] = { x, y, z };
+
+		uint32_t dt = this->has_prev ? t - this->t_prev : 0;
+
+		int16_t d[3];
+		int16_t d_max = 0;
+		for (unsigned i = 0; i < 3; i++) {
+			d[i] = cur[i] - this->prev[i];
+			d_max = std::max<int16_t>(d_max, d[i] < 0 ? -d[i] - 1 : d[i]);
+		}
+
+		enum kind_e kind;
+		if (!this->has_prev || this->n_since_key >= key_interval || d_max > 127)
+			kind = kind_e::KIND_KEY;
+		else if (d_max <= 7)
+			kind = kind_e::KIND_DELTA4;
+		else kind = kind_e::KIND_DELTA8;
+
+		uint8_t tag = (uint8_t)(kind << 6)
+			| (has_status ? tag_status : 0)
+			| (uint8_t)std::min<uint32_t>(dt, tag_dt_varint);
+		this->put(tag);
+		if (dt >= tag_dt_varint)
+			this->put_varint(dt);
+
+		switch (kind) {
+		case kind_e::KIND_DELTA4:
+			this->put((uint8_t)(zigzag(d[0]) | (zigzag(d[1]) << 4)));
+			this->put(zigzag(d[2]));
+			break;
+		case kind_e::KIND_DELTA8:
+			for (auto v : d)
+				this->put(zigzag(v));
+			break;
+		default: {
+			uint32_t packed = ((uint32_t)x & 0x3FF)
+				| (((uint32_t)y & 0x3FF) << 10)
+				| (((uint32_t)z & 0x3FF) << 20);
+			for (unsigned i = 0; i < 4; i++)
+				this->put((uint8_t)(packed >> (8 * i)));
+			this->n_since_key = 0;
+			this->stats_.n_keys += 1;
+			break;
+		}
+		}
+
+		if (has_status)
+			this->put(status);
+
+		this->has_prev = true;
+		this->t_prev = t;
+		std::copy(cur, cur + 3, this->prev);
+		this->n_since_key += 1;
+		this->stats_.n_samples += 1;
+	}
+
+	void flush() {
+		if (this->len == 0)
+			return;
+		this->sink_f(this->buf, this->len, this->sink_data);
+		this->stats_.n_bytes += this->len;
+		this->len = 0;
+	}
+
+	const struct stats_s &stats() const { return this->stats_; }
+};
+
+// replay reader over a complete stream in memory
+class decoder {
+protected:
+	const uint8_t *data;
+	std::size_t len;
+	std::size_t pos = 0;
+
+	uint32_t tick_us_ = 0;
+	bool is_valid = false;
+
+	struct sample_s prev = {};
+	bool has_prev = false;
+
+	bool get(uint8_t &b) {
+		if (this->pos >= this->len)
+			return false;
+		b = this->data[this->pos++];
+		return true;
+	}
+
+	bool get_varint(uint32_t &v) {
+		v = 0;
+		for (unsigned shift = 0; shift < 35; shift += 7) {
+			uint8_t b;
+			if (!this->get(b))
+				return false;
+			v |= (uint32_t)(b & 0x7F) << shift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+public:
+	decoder(const uint8_t *data, std::size_t len) : data(data), len(len) {
+		if (len < header_len || data[0] != 'A' || data[1] != 'T' || data[2] != version)
+			return;
+		for (unsigned i = 0; i < 4; i++)
+			this->tick_us_ |= (uint32_t)data[3 + i] << (8 * i);
+		this->pos = header_len;
+		this->is_valid = true;
+	}
+
+	bool valid() const { return this->is_valid; }
+	uint32_t tick_us() const { return this->tick_us_; }
+
+	// false at the end of the stream or on a malformed record
+	bool next(struct sample_s &s) {
+		if (!this->is_valid)
+			return false;
+
+		uint8_t tag;
+		if (!this->get(tag))
+			return false;
+
+		uint32_t dt = tag & tag_dt_mask;
+		if (dt == tag_dt_varint && !this->get_varint(dt))
+			return false;
+
+		enum kind_e kind = (enum kind_e)(tag >> 6);
+		if (kind != kind_e::KIND_KEY && !this->has_prev)
+			return false;
+
+		s = this->prev;
+		s.t = this->has_prev ? this->prev.t + dt : 0;
+
+		uint8_t b[4];
+		switch (kind) {
+		case kind_e::KIND_DELTA4:
+			if (!this->get(b[0]) || !this->get(b[1]))
+				return false;
+			s.x += unzigzag(b[0] & 0xF);
+			s.y += unzigzag(b[0] >> 4);
+			s.z += unzigzag(b[1] & 0xF);
+			break;
+		case kind_e::KIND_DELTA8:
+			if (!this->get(b[0]) || !this->get(b[1]) || !this->get(b[2]))
+				return false;
+			s.x += unzigzag(b[0]);
+			s.y += unzigzag(b[1]);
+			s.z += unzigzag(b[2]);
+			break;
+		case kind_e::KIND_KEY: {
+			uint32_t packed = 0;
+			for (unsigned i = 0; i < 4; i++) {
+				if (!this->get(b[i]))
+					return false;
+				packed |= (uint32_t)b[i] << (8 * i);
+			}
+			s.x = sign_extend10(packed);
+			s.y = sign_extend10(packed >> 10);
+			s.z = sign_extend10(packed >> 20);
+			break;
+		}
+		default:
+			return false;
+		}
+
+		s.has_status = tag & tag_status;
+		s.status = 0;
+		if (s.has_status && !this->get(s.status))
+			return false;
+
+		this->prev = s;
+		this->has_prev = true;
+		return true;
+	}
+};
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "src/stble/STBLE/src/STBLE.h"
+
+
+// ACI/HCI command descriptors
+// a command is described by its opcode, completion event, response and the parts of its
+//	parameters in wire order, the encoder and the response decoder are generated from it
+// NOTE the HCI wire format and the Cortex-M0+ are both little endian:
+//	packed parameter and response structs are the wire format, no per-field conversion
+namespace stble::aci {
+static_assert(
+	__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+	"packed structs are not the HCI wire format"
+);
+
+// variable length part of the parameters, sent from the caller's buffer
+struct bytes_s {
+	const void *data;
+	uint8_t len;
+};
+
+// response of the commands returning their status only
+struct status_rp_s {
+	uint8_t status;
+} __attribute__((packed));
+
+// UUID of `type` (UUID_TYPE_16 or UUID_TYPE_128)
+inline struct bytes_s uuid(uint8_t type, const uint8_t *uuid) {
+	return { .data = uuid, .len = (uint8_t)(type == UUID_TYPE_16 ? 2 : 16) };
+}
+
+// `event`: 0 for completion by EVT_CMD_COMPLETE,
+//	EVT_CMD_STATUS or a LE meta subevent otherwise (see `hci_send_req`)
+// `parts_t`: fixed size packed structs or `bytes_s`
+template <
+	uint16_t ogf_, uint16_t ocf_,
+	typename rp_type = struct status_rp_s, int event_ = 0,
+	typename... parts_t
+>
+struct command {
+	static const constexpr uint16_t
+		ogf = ogf_,
+		ocf = ocf_,
+		opcode = cmd_opcode_pack(ogf_, ocf_);
+	static const constexpr int event = event_;
+
+	using rp_t = rp_type;
+
+	static_assert(std::is_trivially_copyable_v<rp_t>, "response not trivially copyable");
+	static_assert(
+		(std::is_trivially_copyable_v<parts_t> && ...),
+		"parameter part not trivially copyable"
+	);
+
+protected:
+	static const constexpr std::size_t n_parts = sizeof...(parts_t);
+	// NOTE hci_send_cmdv prepends the header
+	static const constexpr bool scatter = n_parts <= HAL_IOV_MAX - 1;
+
+	static void to_iov(tHalIovec &iov, const struct bytes_s &b) {
+		iov = { .base = b.data, .len = b.len };
+	}
+
+	template <typename part_t>
+	static void to_iov(tHalIovec &iov, const part_t &p) {
+		iov = { .base = &p, .len = sizeof(part_t) };
+	}
+
+	// NOTE parameters gathered into `buf` if they do not fit in an iovec,
+	//	the command is sent before the buffers go out of scope
+	static bool encode(
+		struct hci_request &rq, tHalIovec *iov, uint8_t *buf,
+		const parts_t &...parts
+	) {
+		std::memset(&rq, 0, sizeof(rq));
+		rq.ogf = ogf;
+		rq.ocf = ocf;
+		rq.event = event;
+		if constexpr (n_parts > 0) {
+			std::size_t i = 0, clen = 0;
+			(to_iov(iov[i++], parts), ...);
+			for (i = 0; i < n_parts; i++)
+				clen += iov[i].len;
+			if (clen > HCI_MAX_PAYLOAD_SIZE)
+				return false;
+
+			if constexpr (scatter) {
+				rq.ciov = iov;
+				rq.ciovcnt = n_parts;
+			} else {
+				std::size_t off = 0;
+				for (i = 0; i < n_parts; i++) {
+					std::memcpy(buf + off, iov[i].base, iov[i].len);
+					off += iov[i].len;
+				}
+				rq.cparam = buf;
+				rq.clen = clen;
+			}
+		}
+		return true;
+	}
+
+public:
+	// NOTE `rp` is valid if BLE_STATUS_SUCCESS
+	static tBleStatus send(rp_t &rp, const parts_t &...parts) {
+		struct hci_request rq;
+		tHalIovec iov[n_parts > 0 ? n_parts : 1];
+		uint8_t buf[scatter ? 1 : HCI_MAX_PAYLOAD_SIZE];
+		if (!encode(rq, iov, buf, parts...))
+			return BLE_STATUS_INVALID_PARAMS;
+
+		std::memset(&rp, 0, sizeof(rp));
+		rq.rparam = &rp;
+		rq.rlen = sizeof(rp);
+		if (hci_send_req(&rq, FALSE) < 0)
+			return BLE_STATUS_TIMEOUT;
+		return rp.status;
+	}
+
+	static tBleStatus send(const parts_t &...parts) {
+		rp_t rp;
+		return send(rp, parts...);
+	}
+
+	// see `hci_send_req_cb`, the response is decoded with `decode`
+	static tBleStatus send_async(hci_cmd_cb_t cb, void *data, const parts_t &...parts) {
+		struct hci_request rq;
+		tHalIovec iov[n_parts > 0 ? n_parts : 1];
+		uint8_t buf[scatter ? 1 : HCI_MAX_PAYLOAD_SIZE];
+		if (!encode(rq, iov, buf, parts...))
+			return BLE_STATUS_INVALID_PARAMS;
+
+		if (hci_send_req_cb(&rq, cb, data) < 0)
+			return BLE_STATUS_INSUFFICIENT_RESOURCES;
+		return BLE_STATUS_SUCCESS;
+	}
+
+	// nullptr if the response is truncated
+	// NOTE packed, fields may be unaligned
+	static const rp_t *decode(const uint8_t *rparam, uint8_t rlen) {
+		if (rparam == nullptr || rlen < sizeof(rp_t))
+			return nullptr;
+		return (const rp_t *)rparam;
+	}
+};
+
+// parameter parts
+
+struct length_s {
+	uint8_t len;
+} __attribute__((packed));
+
+struct hal_write_config_data_cp_s {
+	uint8_t offset;
+	uint8_t len;
+	// followed by the value
+} __attribute__((packed));
+
+struct gap_set_discoverable_cp_s {
+	uint8_t adv_type;
+	uint16_t adv_intvl_min, adv_intvl_max;
+	uint8_t own_addr_type;
+	uint8_t adv_filter_policy;
+	uint8_t local_name_len;
+	// followed by the local name, the service UUID list (length prefixed)
+	//	and `conn_intvl_s`
+} __attribute__((packed));
+
+struct conn_intvl_s {
+	uint16_t min, max;
+} __attribute__((packed));
+
+struct gatt_add_serv_cp_s {
+	uint8_t uuid_type;
+	// followed by the UUID and `gatt_add_serv_tail_s`
+} __attribute__((packed));
+
+struct gatt_add_serv_tail_s {
+	uint8_t serv_type;
+	uint8_t max_attr_records;
+} __attribute__((packed));
+
+struct gatt_add_char_cp_s {
+	uint16_t serv_handle;
+	uint8_t uuid_type;
+	// followed by the UUID and `gatt_add_char_tail_s`
+} __attribute__((packed));
+
+struct gatt_add_char_tail_s {
+	uint8_t value_len;
+	uint8_t props;
+	uint8_t sec_perms;
+	uint8_t evt_mask;
+	uint8_t enc_key_size;
+	uint8_t is_variable;
+} __attribute__((packed));
+
+// commands used by stble
+// NOTE see the matching `aci_*`/`hci_le_*` functions for the parameters
+// NOTE only the commands stble sends are described, the other ones stay on the
+//	C functions of the library (its API, e.g. examples/UARTPassThrough); the sketch
+//	calls none of them, unreferenced functions are left out by --gc-sections
+
+using hal_write_config_data = command<
+	OGF_VENDOR_CMD, OCF_HAL_WRITE_CONFIG_DATA, struct status_rp_s, 0,
+	struct hal_write_config_data_cp_s, struct bytes_s
+>;
+using hal_set_tx_power_level = command<
+	OGF_VENDOR_CMD, OCF_HAL_SET_TX_POWER_LEVEL, struct status_rp_s, 0,
+	hal_set_tx_power_level_cp
+>;
+using hal_device_standby = command<OGF_VENDOR_CMD, OCF_HAL_DEVICE_STANDBY>;
+
+using gap_init = command<
+	OGF_VENDOR_CMD, OCF_GAP_INIT, gap_init_rp, 0,
+	gap_init_cp_IDB05A1
+>;
+using gap_set_discoverable = command<
+	OGF_VENDOR_CMD, OCF_GAP_SET_DISCOVERABLE, struct status_rp_s, 0,
+	struct gap_set_discoverable_cp_s, struct bytes_s,
+	struct length_s, struct bytes_s,
+	struct conn_intvl_s
+>;
+using gap_set_non_discoverable = command<OGF_VENDOR_CMD, OCF_GAP_SET_NON_DISCOVERABLE>;
+using gap_terminate = command<
+	OGF_VENDOR_CMD, OCF_GAP_TERMINATE, struct status_rp_s, EVT_CMD_STATUS,
+	gap_terminate_cp
+>;
+
+using gatt_init = command<OGF_VENDOR_CMD, OCF_GATT_INIT>;
+using gatt_add_serv = command<
+	OGF_VENDOR_CMD, OCF_GATT_ADD_SERV, gatt_add_serv_rp, 0,
+	struct gatt_add_serv_cp_s, struct bytes_s, struct gatt_add_serv_tail_s
+>;
+using gatt_add_char = command<
+	OGF_VENDOR_CMD, OCF_GATT_ADD_CHAR, gatt_add_char_rp, 0,
+	struct gatt_add_char_cp_s, struct bytes_s, struct gatt_add_char_tail_s
+>;
+using gatt_update_char_value = command<
+	OGF_VENDOR_CMD, OCF_GATT_UPD_CHAR_VAL, struct status_rp_s, 0,
+	gatt_upd_char_val_cp, struct bytes_s
+>;
+using gatt_allow_read = command<
+	OGF_VENDOR_CMD, OCF_GATT_ALLOW_READ, struct status_rp_s, 0,
+	gatt_allow_read_cp
+>;
+
+using le_set_scan_resp_data = command<
+	OGF_LE_CTL, OCF_LE_SET_SCAN_RESPONSE_DATA, struct status_rp_s, 0,
+	le_set_scan_response_data_cp
+>;
+}
@@ -4,10 +4,13 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <tuple>
 
 #include "arduino.h"
 
 #include "i2c.h"
+#include "utils.h"
 
 
 namespace bma250 {
@@ -285,16 +288,238 @@ struct register_map_s {
 		bool reset_int : 1;
 	} __attribute__((packed)) intt_ctrl;
 
-	// NOTE not implemented
+	/* 4.8 Interrupt controller */
+	// Table 47 - 48: Low-g interrupt, registers (0x22) and (0x23)
+	// NOTE delay = (low_dur + 1) * 2ms, threshold = low_th * 7.81mg
+	uint8_t low_dur;
+	uint8_t low_th;
+
+	// Table 49: Low-g / high-g hysteresis and low-g mode, register (0x24)
+	enum low_mode_e : uint8_t {
+		LOWMODE_SINGLE = 0,	// |a_x|, |a_y|, |a_z| each below the threshold
+		LOWMODE_SUM    = 1	// |a_x| + |a_y| + |a_z| below the threshold
+	};
+	struct low_high_hy_conf_s {
+		// NOTE hysteresis = low_hy * 125mg
+		uint8_t low_hy : 2;
+		enum low_mode_e low_mode : 1;
+		char : 3;
+		// NOTE hysteresis = high_hy * 125mg (2g range)
+		uint8_t high_hy : 2;
+	} __attribute__((packed)) low_high_hy_conf;
+
+	// Table 50 - 51: High-g interrupt, registers (0x25) and (0x26)
+	// NOTE delay = (high_dur + 1) * 2ms, threshold = high_th * 7.81mg (2g range)
+	uint8_t high_dur;
+	uint8_t high_th;
+
+	// Table 52 - 53: Slope interrupt, registers (0x27) and (0x28)
+	struct slope_dur_conf_s {
+		// NOTE slope_dur + 1 consecutive samples above the threshold
+		uint8_t slope_dur : 2;
+		char : 6;
+	} __attribute__((packed)) slope_dur_conf;
+	// NOTE threshold = slope_th * 3.91mg (2g range)
+	uint8_t slope_th;
+
+	// Register (0x29) is reserved.
+	char : 8;
+
+	// Table 54 - 55: Tap interrupt, registers (0x2A) and (0x2B)
+	enum tap_dur_e : uint8_t {
+		TAPDUR_50MS  = 0b000,
+		TAPDUR_100MS = 0b001,
+		TAPDUR_150MS = 0b010,
+		TAPDUR_200MS = 0b011,
+		TAPDUR_250MS = 0b100,
+		TAPDUR_375MS = 0b101,
+		TAPDUR_500MS = 0b110,
+		TAPDUR_700MS = 0b111
+	};
+	enum tap_samp_e : uint8_t {
+		TAPSAMP_2  = 0b00,
+		TAPSAMP_4  = 0b01,
+		TAPSAMP_8  = 0b10,
+		TAPSAMP_16 = 0b11
+	};
+	struct tap_conf_s {
+		// second tap window (double tap)
+		enum tap_dur_e tap_dur : 3;
+		char : 3;
+		// false: 50ms, true: 75ms
+		bool tap_shock : 1;
+		// false: 30ms, true: 20ms
+		bool tap_quiet : 1;
+
+		// NOTE threshold = tap_th * 62.5mg (2g range)
+		uint8_t tap_th : 5;
+		char : 1;
+		enum tap_samp_e tap_samp : 2;
+	} __attribute__((packed)) tap_conf;
+
+	// Table 56 - 57: Orientation interrupt, registers (0x2C) and (0x2D)
+	enum orient_mode_e : uint8_t {
+		ORIENTMODE_SYMMETRICAL     = 0b00,
+		ORIENTMODE_HIGH_ASYMMETRIC = 0b01,
+		ORIENTMODE_LOW_ASYMMETRIC  = 0b10
+	};
+	enum orient_blocking_e : uint8_t {
+		ORIENTBLOCK_NONE         = 0b00,
+		ORIENTBLOCK_THETA        = 0b01,
+		ORIENTBLOCK_THETA_SLOPE  = 0b10,
+		ORIENTBLOCK_THETA_SLOPE_ANY = 0b11
+	};
+	struct orient_conf_s {
+		enum orient_mode_e orient_mode : 2;
+		enum orient_blocking_e orient_blocking : 2;
+		// NOTE hysteresis = orient_hyst * 62.5mg
+		uint8_t orient_hyst : 3;
+		char : 1;
+
+		// NOTE blocking angle, theta = atan(sqrt(orient_theta / 8))
+		uint8_t orient_theta : 6;
+		// report up/down changes of the z axis as well
+		bool orient_ud_en : 1;
+		char : 1;
+	} __attribute__((packed)) orient_conf;
+
+	// Table 58 - 59: Flat interrupt, registers (0x2E) and (0x2F)
+	enum flat_hold_e : uint8_t {
+		FLATHOLD_0MS    = 0b00,
+		FLATHOLD_512MS  = 0b01,
+		FLATHOLD_1024MS = 0b10,
+		FLATHOLD_2048MS = 0b11
+	};
+	struct flat_conf_s {
+		// NOTE theta = atan(sqrt(flat_theta / 8))
+		uint8_t flat_theta : 6;
+		char : 2;
+
+		char : 4;
+		enum flat_hold_e flat_hold : 2;
+		char : 2;
+	} __attribute__((packed)) flat_conf;
+
+	// NOTE self test, offset compensation and beyond (0x30 - ) not implemented
 } __attribute__((packed));
 
 using accl_dataset_t = register_map_s::accl_dataset_s;
 using range_preset_t = register_map_s::range_e;
 using intvl_preset_t = register_map_s::bw_e;
 
+// typed register field: address and width known at compile time
+// NOTE whole registers only, bitfields are changed through `bma250::update`
+template <uint8_t addr_, typename data_type>
+struct register_field {
+	using type = data_type;
+
+	static const constexpr uint8_t addr = addr_;
+	static const constexpr std::size_t len = sizeof(data_type);
+};
+
+// field: the name of field inside bma250::register_map (e.g. intt_stat.intt)
+#define bma250_register_field_type(field)	\
+	decltype(((::bma250::register_map_s *)nullptr)->field)
+
+#define bma250_register_field(field)	\
+	::bma250::register_field<	\
+		offsetof(::bma250::register_map_s, field),	\
+		bma250_register_field_type(field)	\
+	>
+
+// true if each field starts where the previous one ends
+template <typename field_type, typename... field_types>
+constexpr bool is_contiguous() {
+	if constexpr (sizeof...(field_types) == 0)
+		return true;
+	else {
+		using next = std::tuple_element_t<0, std::tuple<field_types...>>;
+		return field_type::addr + field_type::len == next::addr
+			&& is_contiguous<field_types...>();
+	}
+}
+
+namespace fields {
+using chip_id        = bma250_register_field(chip_id);
+using accl_dataset   = bma250_register_field(accl_dataset);
+using temp_data      = bma250_register_field(temp_data);
+using intt_stat      = bma250_register_field(intt_stat);
+using intt_stat_intt = bma250_register_field(intt_stat.intt);
+using range_conf     = bma250_register_field(range_conf);
+using bw_conf        = bma250_register_field(bw_conf);
+using pwr_conf       = bma250_register_field(pwr_conf);
+using softreset      = bma250_register_field(specctrl_conf.softreset);
+using intt_conf      = bma250_register_field(intt_conf);
+using intt_map_conf  = bma250_register_field(intt_map_conf);
+using intt_dsrc_conf = bma250_register_field(intt_dsrc_conf);
+using intt_elec_conf = bma250_register_field(intt_elec_conf);
+using intt_ctrl      = bma250_register_field(intt_ctrl);
+using low_dur        = bma250_register_field(low_dur);
+using low_th         = bma250_register_field(low_th);
+using low_high_hy_conf = bma250_register_field(low_high_hy_conf);
+using high_dur       = bma250_register_field(high_dur);
+using high_th        = bma250_register_field(high_th);
+using slope_dur_conf = bma250_register_field(slope_dur_conf);
+using slope_th       = bma250_register_field(slope_th);
+using tap_conf       = bma250_register_field(tap_conf);
+using orient_conf    = bma250_register_field(orient_conf);
+using flat_conf      = bma250_register_field(flat_conf);
+}
+
+// 3 x 10 bit two's complement sample packed in a word
+// NOTE bit 30 flags a slope event seen with the sample
+struct sample_s {
+	uint32_t val;
+	// data-ready count at the read, wrapping; gaps are decimation or overruns
+	uint16_t seq;
+	// raw interrupt status (0x09) read along, see `register_map_s::intt_stat_s::intt_s`
+	uint8_t intt;
+
+	static constexpr uint32_t mask = (1ul << 10) - 1;
+	static constexpr uint32_t slope_bit = 1ul << 30;
+
+	static sample_s pack(
+		const accl_dataset_t &d, bool slope = false,
+		uint16_t seq = 0, uint8_t intt = 0
+	) {
+		return (sample_s) {
+			.val = ((uint32_t)d.x.acc & mask)
+				| (((uint32_t)d.y.acc & mask) << 10)
+				| (((uint32_t)d.z.acc & mask) << 20)
+				| (slope ? slope_bit : 0),
+			.seq = seq,
+			.intt = intt
+		};
+	}
+
+	// sign extend the 10 bit axis at `shift`
+	constexpr int16_t axis(unsigned shift) const {
+		return (int16_t)((int32_t)(this->val << (22 - shift)) >> 22);
+	}
+
+	constexpr int16_t x() const { return this->axis(0); }
+	constexpr int16_t y() const { return this->axis(10); }
+	constexpr int16_t z() const { return this->axis(20); }
+	constexpr bool slope() const { return this->val & slope_bit; }
+
+	operator std::string() const {
+		return "x = " + std::to_string(this->x()) + ", "
+			+ "y = " + std::to_string(this->y()) + ", "
+			+ "z = " + std::to_string(this->z())
+			+ (this->slope() ? ", slope" : "");
+	}
+};
+
 enum event_e {
 	NEW_DATA,
-	SLOPE
+	SLOPE,
+	// free fall
+	LOW_G,
+	HIGH_G,
+	TAP_SINGLE,
+	TAP_DOUBLE,
+	ORIENT,
+	FLAT
 };
 
 enum interrupt_e {
@@ -304,17 +529,77 @@ enum interrupt_e {
 
 class bma250 {
 protected:
-	// TODO dependency
-	using i2c_io = vendor_samd::i2c_socket::primary;
+	// NOTE per-device handle on a shared bus
+	using i2c_io = vendor_samd::i2c_bus::device;
 
 	i2c_io *io = nullptr;
 
+	// write-through shadow of the configuration registers (0x0F - 0x2F)
+	// NOTE a register is known once written or read, soft reset forgets all of them
+	struct shadow_s {
+		static const constexpr uint8_t
+			addr_first = fields::range_conf::addr,
+			addr_last = fields::flat_conf::addr + fields::flat_conf::len - 1;
+
+		uint8_t regs[addr_last - addr_first + 1] = {};
+		uint64_t valid = 0;
+
+		static constexpr bool covers(uint8_t addr) {
+			return addr >= addr_first && addr <= addr_last;
+		}
+
+		bool get(uint8_t addr, char &data) const {
+			if (!covers(addr) || !(this->valid & (1ull << (addr - addr_first))))
+				return false;
+			data = this->regs[addr - addr_first];
+			return true;
+		}
+
+		void set(uint8_t addr, char data) {
+			if (!covers(addr))
+				return;
+			this->regs[addr - addr_first] = data;
+			this->valid |= 1ull << (addr - addr_first);
+		}
+
+		void invalidate() { this->valid = 0; }
+	} shadow;
+
+	// command registers, never cached or skipped
+	static const constexpr uint8_t
+		addr_softreset = fields::softreset::addr,
+		addr_intt_ctrl = fields::intt_ctrl::addr;
+	// Table 46: reset_int, self-clearing
+	static const constexpr char intt_ctrl_reset_int = (char)(1 << 7);
+	// power mode, cached as any other register; its writes set `needs_idle`
+	static const constexpr uint8_t addr_pwr_conf = fields::pwr_conf::addr;
+
+	// NOTE "In low-power mode ... an interface idle time of at least 450us is required"
+	// 	between consecutive writes (suspend mode alike), see 4.7 Power modes
+	static const constexpr uint32_t idle_us = 600;
+	// low-power or suspend mode on, as last written to `pwr_conf`
+	bool needs_idle = false;
+	uint32_t t_write = 0;
+
 	std::size_t _write(
 		const uint8_t &addr,
 		const char &data
 	) {
 		// NOTE bma250 only allows one byte per write transaction
 
+		// redundant write
+		char cur;
+		bool is_cmd = addr == addr_softreset
+			|| (addr == addr_intt_ctrl && (data & intt_ctrl_reset_int));
+		if (!is_cmd && this->shadow.get(addr, cur) && cur == data)
+			return sizeof(data);
+
+		if (this->needs_idle) {
+			uint32_t dt = micros() - this->t_write;
+			if (dt < idle_us)
+				delayMicroseconds(idle_us - dt);
+		}
+
 		struct packet_s {
 			uint8_t reg_addr;
 			char payload;
@@ -323,7 +608,25 @@ protected:
 			.payload = data
 		};
 
-		return this->io->send(&p, sizeof(p));
+		if (this->io->send(&p, sizeof(p)) < sizeof(p))
+			return 0;
+		this->t_write = micros();
+
+		if (addr == addr_pwr_conf) {
+			register_map_s::pwr_conf_s c;
+			std::memcpy(&c, &data, sizeof(c));
+			this->needs_idle = c.lowpower_en || c.suspend;
+		}
+
+		if (addr == addr_softreset) {
+			// NOTE back in normal mode
+			this->needs_idle = false;
+			this->shadow.invalidate();
+		} else if (addr == addr_intt_ctrl)
+			this->shadow.set(addr, data & ~intt_ctrl_reset_int);
+		else this->shadow.set(addr, data);
+
+		return sizeof(data);
 	}
 
 	std::size_t _read(
@@ -339,7 +642,12 @@ protected:
 		// closed
 		if (this->io->send(&p, sizeof(p)) == 0)
 			return 0;
-		return this->io->recv(data, len);
+
+		std::size_t rlen = this->io->recv(data, len);
+		for (std::size_t i = 0; i < rlen; i++)
+			if (addr + i != addr_softreset)
+				this->shadow.set(addr + i, data[i]);
+		return rlen;
 	}
 
 public:
@@ -360,8 +668,9 @@ public:
 		std::size_t len_ = 0;
 		std::size_t slen;
 
+		// NOTE one register per transaction, consecutive addresses
 		while (len_ < len) {
-			slen = this->_write(addr, data[len_]);
+			slen = this->_write(addr + len_, data[len_]);
 			// closed
 			if (slen == 0)
 				return len_;
@@ -377,6 +686,17 @@ public:
 		char *data, std::size_t len
 	) { return this->_read(addr, data, len); }
 
+	// read from the shadow if every register is known, from the device otherwise
+	std::size_t read_cached(
+		const uint8_t &addr,
+		char *data, std::size_t len
+	) {
+		for (std::size_t i = 0; i < len; i++)
+			if (!this->shadow.get(addr + i, data[i]))
+				return this->read(addr, data, len);
+		return len;
+	}
+
 	template <typename data_type>
 	std::size_t write(const uint8_t addr, const data_type &data) {
 		return this->write(addr, (char *)&data, sizeof(data));
@@ -387,23 +707,76 @@ public:
 		return this->read(addr, (char *)&data, sizeof(data));
 	}
 
-	// register manipulation convenience macros 
-	#define bma250_register_field_type(field)	\
-		decltype(((::bma250::register_map_s *)nullptr)->field)
+	template <typename data_type>
+	std::size_t read_cached(const uint8_t addr, data_type &data) {
+		return this->read_cached(addr, (char *)&data, sizeof(data));
+	}
+
+	// typed register access, see `fields`
+	template <typename field_type>
+	typename field_type::type get() {
+		typename field_type::type res;
+		this->read(field_type::addr, res);
+		return res;
+	}
+
+	template <typename field_type>
+	std::size_t set(const typename field_type::type &data) {
+		return this->write(field_type::addr, data);
+	}
+
+	// read-modify-write with the shadow: a single write per changed register
+	template <typename field_type, typename fn_type>
+	std::size_t update(fn_type fn) {
+		typename field_type::type data;
+		this->read_cached(field_type::addr, data);
+		fn(data);
+		return this->set<field_type>(data);
+	}
 
-	// this is ugly has hell but there's no way around it
-	// field: the name of field inside bma250::register_map (e.g. intt_stat.intt)
+	// one burst transaction over contiguous fields
+	template <typename... field_types>
+	std::tuple<typename field_types::type...> get_burst() {
+		static_assert(is_contiguous<field_types...>(), "fields not contiguous");
+
+		using first = std::tuple_element_t<0, std::tuple<field_types...>>;
+		char buf[(field_types::len + ...)];
+		this->read(first::addr, buf, sizeof(buf));
+
+		std::tuple<typename field_types::type...> res;
+		std::size_t off = 0;
+		std::apply([&buf, &off](auto &... data) {
+			((std::memcpy(&data, buf + off, sizeof(data)), off += sizeof(data)), ...);
+		}, res);
+		return res;
+	}
+
+	// queue a read of contiguous fields, safe from interrupt context
+	// NOTE `buf` must stay valid until `cb` is called, see `i2c_bus::device::submit`
+	template <typename... field_types>
+	vendor_samd::i2c_status submit_read(
+		void *buf,
+		void (*cb)(const vendor_samd::i2c_bus::transaction &, vendor_samd::i2c_status),
+		void *data
+	) {
+		static_assert(is_contiguous<field_types...>(), "fields not contiguous");
+
+		using first = std::tuple_element_t<0, std::tuple<field_types...>>;
+		return this->io->submit(
+			&first::addr, sizeof(first::addr),
+			buf, (field_types::len + ...),
+			cb, data
+		);
+	}
+
+	// register manipulation convenience macros
 	// accl: a bma250::bma250 object
-	#define bma250_register_read(accl, field) ({	\
-		bma250_register_field_type(field) __r;	\
-		(accl)->read(offsetof(::bma250::register_map_s, field), __r);	\
-		__r;	\
-	})
+	#define bma250_register_read(accl, field)	\
+		((accl)->get<bma250_register_field(field)>())
 
-	#define bma250_register_write(accl, field, ...) ({	\
-		(accl)->write(offsetof(::bma250::register_map_s, field),	\
-			((bma250_register_field_type(field))__VA_ARGS__));	\
-	})
+	#define bma250_register_write(accl, field, ...)	\
+		((accl)->set<bma250_register_field(field)>(	\
+			(bma250_register_field_type(field))__VA_ARGS__))
 
 	using reg = register_map_s;
 
@@ -412,6 +785,8 @@ public:
 			specctrl_conf.softreset, 
 			reg::RESETCMD_SOFT
 		);
+		// NOTE registers are back to their defaults even if the ack got lost
+		this->shadow.invalidate();
 		/*while (
 			bma250_register_read(this, 
 				specctrl_conf.softreset
@@ -419,128 +794,167 @@ public:
 		);*/
 	}
 
+	// NOTE a single write once `intt_ctrl` is known (e.g. after `listen`)
 	void accept() {
-		reg::intt_ctrl_s intt_ctrl;
-		this->read(offsetof(reg, intt_ctrl), intt_ctrl);
-		
-		intt_ctrl.reset_int = true;
-		this->write(offsetof(reg, intt_ctrl), intt_ctrl);
+		this->update<fields::intt_ctrl>([](reg::intt_ctrl_s &intt_ctrl) {
+			intt_ctrl.reset_int = true;
+		});
 	}
 
 	using latch_e = reg::latch_e;
 	
-	void listen(event_e ev, 
-		interrupt_e intt, 
-		bool req_accept = false,
-		bool enable = true
-	) {
-		reg::intt_conf_s intt_conf = {
-			.slope_en_x = false,
-			.slope_en_y = false,
-			.slope_en_z = false,
-			.d_tap_en = false,
-			.s_tap_en = false,
-			.orient_en = false,
-			.flat_en = false,
-
-			.high_en_x = false,
-			.high_en_y = false,
-			.high_en_z = false,
-			.low_en = false,
-			.data_en = false
-		};
-
+protected:
+	// engine enable bits of `ev`
+	static void conf_event(reg::intt_conf_s &c, event_e ev, bool enable) {
 		switch (ev) {
 		case event_e::NEW_DATA:
-			intt_conf.data_en = enable;
+			c.data_en = enable;
 			break;
 		case event_e::SLOPE:
-			intt_conf.slope_en_x
-				= intt_conf.slope_en_y
-				= intt_conf.slope_en_z
-				= enable;
+			c.slope_en_x = c.slope_en_y = c.slope_en_z = enable;
+			break;
+		case event_e::LOW_G:
+			c.low_en = enable;
+			break;
+		case event_e::HIGH_G:
+			c.high_en_x = c.high_en_y = c.high_en_z = enable;
+			break;
+		case event_e::TAP_SINGLE:
+			c.s_tap_en = enable;
+			break;
+		case event_e::TAP_DOUBLE:
+			c.d_tap_en = enable;
+			break;
+		case event_e::ORIENT:
+			c.orient_en = enable;
+			break;
+		case event_e::FLAT:
+			c.flat_en = enable;
 			break;
 		}
+	}
 
-		/*
-		reg::intt_map_conf_s intt_map_conf = {};
+	// pin mapping bit of `ev` on `intt`
+	static void map_event(reg::intt_map_conf_s &m, event_e ev, interrupt_e intt, bool enable) {
+		const bool int1 = intt == interrupt_e::INT1;
 		switch (ev) {
 		case event_e::NEW_DATA:
-			switch (intt) {
-			case interrupt_e::INT1:
-				intt_map_conf.int1_data = enable;
-				break;
-			case interrupt_e::INT2:
-				intt_map_conf.int2_data = enable;
-				break;
-			}
+			if (int1) m.int1_data = enable; else m.int2_data = enable;
 			break;
 		case event_e::SLOPE:
-			switch (intt) {
-			case interrupt_e::INT1:
-				intt_map_conf.int1_slope = enable;
-				break;
-			case interrupt_e::INT2:
-				intt_map_conf.int2_slope = enable;
-				break;
-			}
+			if (int1) m.int1_slope = enable; else m.int2_slope = enable;
 			break;
-		}
-
-		reg::intt_elec_conf_s intt_elec_conf = {};
-		switch (intt) {
-		case interrupt_e::INT1:
-			intt_elec_conf.int1_od = false;
-			intt_elec_conf.int1_lvl = false;
+		case event_e::LOW_G:
+			if (int1) m.int1_low = enable; else m.int2_low = enable;
+			break;
+		case event_e::HIGH_G:
+			if (int1) m.int1_high = enable; else m.int2_high = enable;
+			break;
+		case event_e::TAP_SINGLE:
+			if (int1) m.int1_s_tap = enable; else m.int2_s_tap = enable;
+			break;
+		case event_e::TAP_DOUBLE:
+			if (int1) m.int1_d_tap = enable; else m.int2_d_tap = enable;
 			break;
-		case interrupt_e::INT2:
-			intt_elec_conf.int2_od = false;
-			intt_elec_conf.int2_lvl = false;
+		case event_e::ORIENT:
+			if (int1) m.int1_orient = enable; else m.int2_orient = enable;
+			break;
+		case event_e::FLAT:
+			if (int1) m.int1_flat = enable; else m.int2_flat = enable;
 			break;
 		}
+	}
 
-		this->write(
-			offsetof(reg, intt_map_conf),
-			intt_map_conf
-		);
-		this->write(
-			offsetof(reg, intt_elec_conf),
-			intt_elec_conf
-		);*/
+public:
+	// route `ev` to `intt`, push-pull active high
+	// NOTE other subscriptions are kept, several engines may share a pin;
+	//	with `req_accept` interrupts are latched until `accept` (applies to all engines)
+	void listen(event_e ev, 
+		interrupt_e intt, 
+		bool req_accept = false,
+		bool enable = true
+	) {
+		// Table 45: active high (power-on default), push-pull
+		reg::intt_elec_conf_s intt_elec_conf = {
+			.int1_lvl = true,
+			.int1_od = false,
+			.int2_lvl = true,
+			.int2_od = false
+		};
 
-		// TODO 
-		if (enable)
-			this->listen(ev, intt, req_accept, false);
-		delayMicroseconds(600);
+		// NOTE writes are spaced out in low-power mode, see `idle_us`
 
+		// latch mode first, clearing whatever is latched from before
 		bma250_register_write(this, intt_ctrl, { 
 			.latch_int = req_accept
 				? reg::LATCHMODE_FULL
 				: reg::LATCHMODE_NONE,
-			.reset_int = false
+			.reset_int = true
 		});
 
-		bma250_register_write(this, intt_conf, intt_conf);		
+		this->update<fields::intt_map_conf>([ev, intt, enable](reg::intt_map_conf_s &m) {
+			map_event(m, ev, intt, enable);
+		});
+		bma250_register_write(this, intt_elec_conf, intt_elec_conf);
+
+		this->update<fields::intt_conf>([ev, enable](reg::intt_conf_s &c) {
+			conf_event(c, ev, enable);
+		});
 	}
 
-	template <typename cb_type>
-	void listen(event_e ev, interrupt_e intt, cb_type cb, bool req_accept = false) {
-		this->listen(ev, intt, cb, req_accept);
+	// which engines fired, see `accept` for latched interrupts
+	reg::intt_stat_s::intt_s pending() {
+		return this->get<fields::intt_stat_intt>();
+	}
 
-		// TODO turn off interrupt??
-		if (cb == nullptr)
-			return;
+	// engine settings, units as in `register_map_s`
+	bma250 &set_slope(uint8_t th, uint8_t dur) {
+		this->set<fields::slope_th>(th);
+		this->set<fields::slope_dur_conf>({ .slope_dur = dur });
+		return *this;
+	}
 
-		// TODO INT1
-		attachInterrupt(13, cb, CHANGE);
-		// TODO INT0
-		//attachInterrupt(11, cb, CHANGE);
+	bma250 &set_low_g(
+		uint8_t th, uint8_t dur, uint8_t hy = 0b01, 
+		reg::low_mode_e mode = reg::LOWMODE_SINGLE
+	) {
+		this->set<fields::low_th>(th);
+		this->set<fields::low_dur>(dur);
+		this->update<fields::low_high_hy_conf>([hy, mode](reg::low_high_hy_conf_s &c) {
+			c.low_hy = hy;
+			c.low_mode = mode;
+		});
+		return *this;
+	}
+
+	bma250 &set_high_g(uint8_t th, uint8_t dur, uint8_t hy = 0b00) {
+		this->set<fields::high_th>(th);
+		this->set<fields::high_dur>(dur);
+		this->update<fields::low_high_hy_conf>([hy](reg::low_high_hy_conf_s &c) {
+			c.high_hy = hy;
+		});
+		return *this;
+	}
+
+	bma250 &set_tap(const reg::tap_conf_s &conf) {
+		this->set<fields::tap_conf>(conf);
+		return *this;
+	}
+
+	bma250 &set_orient(const reg::orient_conf_s &conf) {
+		this->set<fields::orient_conf>(conf);
+		return *this;
+	}
+
+	bma250 &set_flat(uint8_t theta, reg::flat_hold_e hold) {
+		this->set<fields::flat_conf>({ .flat_theta = theta, .flat_hold = hold });
+		return *this;
 	}
 
 	bma250 &set_intvl(intvl_preset_t intvl) {
 		reg::bw_conf_s bw_conf = {};
 		bw_conf.bw = intvl;
-		this->write(offsetof(reg, bw_conf), bw_conf);
+		this->set<fields::bw_conf>(bw_conf);
 		// TODO error handling
 		return *this;
 	}
@@ -548,40 +962,348 @@ public:
 	bma250 &set_range(range_preset_t range) {
 		reg::range_conf_s range_conf = {};
 		range_conf.range = range;
-		this->write(
-			offsetof(
-				reg,
-				range_conf
-			),
-			range_conf
-		);
+		this->set<fields::range_conf>(range_conf);
 		// TODO error handling
 		return *this;
 	}
 
+	// power modes, bytes written (0: failed)
 	using sleepdur_e = reg::sleepdur_e;
-	bma250 &set_lopower(sleepdur_e sleep_dur) {
-		bma250_register_write(this, pwr_conf, {
+	std::size_t set_lopower(sleepdur_e sleep_dur) {
+		return bma250_register_write(this, pwr_conf, {
 			.sleep_dur = sleep_dur,
-			.lowpower_en = true
+			.lowpower_en = true,
+			.suspend = false
 		});
-		return *this;
 	}
 
-	accl_dataset_t read_accl() {
-		reg::accl_dataset_s res;
+	std::size_t set_normal() {
+		return bma250_register_write(this, pwr_conf, {
+			.sleep_dur = reg::DUR_0_5MS,
+			.lowpower_en = false,
+			.suspend = false
+		});
+	}
+
+	// 4.7 Power modes: no sampling, registers kept
+	std::size_t set_suspend() {
+		return bma250_register_write(this, pwr_conf, {
+			.sleep_dur = reg::DUR_0_5MS,
+			.lowpower_en = false,
+			.suspend = true
+		});
+	}
 
+	accl_dataset_t read_accl() {
 		// TODO error checking
-		this->read(
-			offsetof(
-				reg,
-				accl_dataset
-			),
-			res
-		);
+		return this->get<fields::accl_dataset>();
+	}
+};
+
+// sensor power policy
+// normal while streaming, low-power with a sleep phase growing with inactivity,
+//	suspended while motion does not matter (e.g. lost)
+// NOTE driven from the periodic MCU tick so reconfiguration rides on a wake-up
+//	the MCU takes anyway
+// NOTE no alignment of sensor and MCU wake-ups beyond that: in low-power mode the
+//	sensor wakes on its own oscillator to sample, the MCU sees none of it
+//	(no interrupt, no bus traffic) unless a slope event fires, which has to be
+//	served right away; what the governor needs to know is `allows_standby`
+class power_policy {
+public:
+	enum mode_e : uint8_t {
+		MODE_NORMAL,
+		MODE_LOWPOWER,
+		MODE_SUSPEND
+	};
+
+	using sleepdur_e = register_map_s::sleepdur_e;
+
+	struct step_s {
+		// time since the last motion
+		uint32_t idle_ms;
+		sleepdur_e sleep_dur;
+	};
+
+	struct policy_s {
+		// ascending by `idle_ms`
+		// NOTE starts from the 500ms sleep phase used so far: a slope event is only
+		//	acted upon on the next tick, faster sampling would not bring that closer
+		struct step_s steps[2] = {
+			{ 0,     register_map_s::DUR_500MS },
+			{ 30000, register_map_s::DUR_1000MS }
+		};
+	};
+
+protected:
+	bma250 *dev;
+
+	bool streaming = false;
+	bool suspended = false;
+	uint32_t idle_ms = 0;
+
+	// NOTE unknown until the first `apply`
+	bool is_applied = false;
+	enum mode_e mode_ = mode_e::MODE_NORMAL;
+	sleepdur_e sleep_dur_ = register_map_s::DUR_0_5MS;
+
+	// sleep phase duration, see `register_map_s::sleepdur_e`
+	static constexpr uint32_t to_us(sleepdur_e d) {
+		switch (d) {
+		case register_map_s::DUR_0_5MS:  return 500;
+		case register_map_s::DUR_1MS:    return 1000;
+		case register_map_s::DUR_2MS:    return 2000;
+		case register_map_s::DUR_4MS:    return 4000;
+		case register_map_s::DUR_6MS:    return 6000;
+		case register_map_s::DUR_10MS:   return 10000;
+		case register_map_s::DUR_25MS:   return 25000;
+		case register_map_s::DUR_50MS:   return 50000;
+		case register_map_s::DUR_100MS:  return 100000;
+		case register_map_s::DUR_500MS:  return 500000;
+		case register_map_s::DUR_1000MS: return 1000000;
+		}
+		return 0;
+	}
+
+	sleepdur_e select_sleep_dur() const {
+		sleepdur_e res = this->policy.steps[0].sleep_dur;
+		for (const auto &st : this->policy.steps)
+			if (this->idle_ms >= st.idle_ms)
+				res = st.sleep_dur;
+		return res;
+	}
+
+public:
+	struct policy_s policy;
+
+	power_policy(bma250 *dev) : dev(dev) {}
+
+	power_policy &set_streaming(bool streaming) {
+		this->streaming = streaming;
+		return *this;
+	}
+
+	power_policy &set_suspended(bool suspended) {
+		this->suspended = suspended;
+		return *this;
+	}
+
+	// `elapsed_ms` since the last tick, `motion` seen in between
+	power_policy &on_tick(uint32_t elapsed_ms, bool motion) {
+		if (motion) this->idle_ms = 0;
+		else this->idle_ms = std::min<uint32_t>(this->idle_ms + elapsed_ms, UINT32_MAX / 2);
+		return *this;
+	}
+
+	enum mode_e target() const {
+		return this->suspended
+			? mode_e::MODE_SUSPEND
+			: (this->streaming ? mode_e::MODE_NORMAL : mode_e::MODE_LOWPOWER);
+	}
+
+	// reconfigure the device if the target changed, true if it did
+	// NOTE a failed write leaves the policy unapplied, retried on the next call
+	bool apply() {
+		enum mode_e mode = this->target();
+		sleepdur_e sleep_dur = this->select_sleep_dur();
+
+		if (this->is_applied && mode == this->mode_
+			&& (mode != mode_e::MODE_LOWPOWER || sleep_dur == this->sleep_dur_))
+			return false;
+
+		std::size_t wlen = 0;
+		switch (mode) {
+		case mode_e::MODE_NORMAL: wlen = this->dev->set_normal(); break;
+		case mode_e::MODE_LOWPOWER: wlen = this->dev->set_lopower(sleep_dur); break;
+		case mode_e::MODE_SUSPEND: wlen = this->dev->set_suspend(); break;
+		}
+		if (wlen == 0) {
+			this->is_applied = false;
+			return false;
+		}
+
+		this->is_applied = true;
+		this->mode_ = mode;
+		this->sleep_dur_ = sleep_dur;
+		return true;
+	}
+
+	// false until the target mode reached the device
+	bool applied() const { return this->is_applied; }
 
+	enum mode_e mode() const { return this->mode_; }
+
+	// NOTE sampling in normal mode is edge-driven (see `stream`), standby would lose it;
+	//	unknown while unapplied, the target may be streaming already
+	bool allows_standby() const {
+		return this->is_applied
+			&& this->mode_ != mode_e::MODE_NORMAL
+			&& this->target() != mode_e::MODE_NORMAL;
+	}
+
+	operator std::string() const {
+		static const char *const names[] = { "normal", "low-power", "suspend" };
+		return std::string("")
+			+ "mode = " + names[this->mode_] + ", "
+			+ "sleep dur = " + std::to_string(to_us(this->sleep_dur_)) + "us, "
+			+ "idle = " + std::to_string(this->idle_ms) + "ms";
+	}
+};
+
+// data-ready driven sample stream
+// the interrupt queues a burst read, the main loop runs it (`i2c_bus::manager::process`),
+//	completion packs the sample into a ring consumed by the main loop
+// NOTE the burst includes the interrupt status so slope events ride along
+template <std::size_t cap>
+class stream {
+public:
+	struct stats_s {
+		uint32_t n_samples = 0;
+		// data-ready skipped by decimation
+		uint32_t n_decimated = 0;
+		// data-ready while the previous read was still in flight
+		uint32_t n_overrun = 0;
+		// ring full
+		uint32_t n_dropped = 0;
+		uint32_t n_error = 0;
+
+		operator std::string() const {
+			return std::string("")
+				+ "n = " + std::to_string(this->n_samples) + ", "
+				+ "decimated = " + std::to_string(this->n_decimated) + ", "
+				+ "overrun = " + std::to_string(this->n_overrun) + ", "
+				+ "dropped = " + std::to_string(this->n_dropped) + ", "
+				+ "err = " + std::to_string(this->n_error);
+		}
+	};
+
+protected:
+	// 0x02 - 0x09
+	using burst_fields = std::tuple<
+		fields::accl_dataset, 
+		fields::temp_data, 
+		fields::intt_stat_intt
+	>;
+
+	bma250 *dev;
+
+	struct burst_s {
+		accl_dataset_t accl_dataset;
+		uint8_t temp_data;
+		register_map_s::intt_stat_s::intt_s intt;
+	} __attribute__((packed)) buf;
+
+	volatile bool in_flight = false;
+	volatile bool has_slope = false;
+
+	uint8_t decimation = 1;
+	uint8_t n_skip = 0;
+
+	// data-ready count, of the read in flight
+	uint16_t n_ready = 0;
+	uint16_t seq = 0;
+
+	utils::spsc_ring<sample_s, cap> ring;
+
+	struct stats_s stats_ = {};
+
+	static void on_done(
+		const vendor_samd::i2c_bus::transaction &t, 
+		vendor_samd::i2c_status s
+	) {
+		auto *self = (stream *)t.data;
+		auto &st = self->stats_;
+
+		if (s != vendor_samd::i2c_status::ST_SUCCESS) {
+			st.n_error += 1;
+		} else {
+			bool slope = self->buf.intt.slope_int;
+			if (slope)
+				self->has_slope = true;
+			uint8_t intt;
+			std::memcpy(&intt, &self->buf.intt, sizeof(intt));
+			if (!self->ring.push(sample_s::pack(
+				self->buf.accl_dataset, slope, self->seq, intt
+			)))
+				st.n_dropped += 1;
+			st.n_samples += 1;
+		}
+
+		self->in_flight = false;
+	}
+
+public:
+	stream(bma250 *dev) : dev(dev) {}
+
+	// data-ready on INT1, slope detection kept on for `sample_s::slope`
+	// NOTE every `decimation`-th sample is read
+	stream &start(
+		intvl_preset_t intvl,
+		uint8_t decimation = 1,
+		interrupt_e intt = interrupt_e::INT1
+	) {
+		this->decimation = std::max<uint8_t>(decimation, 1);
+		this->n_skip = 0;
+
+		this->dev->set_intvl(intvl);
+		this->dev->listen(event_e::NEW_DATA, intt, false);
+		this->dev->template update<fields::intt_conf>([](register_map_s::intt_conf_s &c) {
+			c.slope_en_x = c.slope_en_y = c.slope_en_z = true;
+		});
+		return *this;
+	}
+
+	stream &stop(interrupt_e intt = interrupt_e::INT1) {
+		this->dev->listen(event_e::NEW_DATA, intt, false, false);
+		return *this;
+	}
+
+	// call on data-ready, safe from interrupt context
+	void on_data_ready() {
+		auto &st = this->stats_;
+
+		this->n_ready += 1;
+
+		if (++this->n_skip < this->decimation) {
+			st.n_decimated += 1;
+			return;
+		}
+		this->n_skip = 0;
+
+		if (this->in_flight) {
+			st.n_overrun += 1;
+			return;
+		}
+
+		this->in_flight = true;
+		this->seq = this->n_ready;
+		auto s = std::apply([this](auto... f) {
+			return this->dev->template submit_read<decltype(f)...>(
+				&this->buf, on_done, this
+			);
+		}, burst_fields());
+		if (s != vendor_samd::i2c_status::ST_SUCCESS) {
+			this->in_flight = false;
+			st.n_error += 1;
+		}
+	}
+
+	// consumer: up to `n` samples, oldest first
+	std::size_t read(sample_s *samples, std::size_t n) {
+		return this->ring.pop(samples, n);
+	}
+
+	bool empty() const { return this->ring.empty(); }
+
+	// slope event seen since the last call
+	bool take_slope() {
+		bool res = this->has_slope;
+		this->has_slope = false;
 		return res;
 	}
+
+	// NOTE not synchronized with the interrupt, figures may be torn
+	const struct stats_s &stats() const { return this->stats_; }
 };
 }
 
@@ -611,15 +1333,45 @@ public:
 		return *this;
 	}
 
-	void listen(::bma250::event_e ev, bool req_accept = false) {
-		return base::listen(ev, ::bma250::interrupt_e::INT1, req_accept);
+	void listen(::bma250::event_e ev, bool req_accept = false, bool enable = true) {
+		return base::listen(ev, ::bma250::interrupt_e::INT1, req_accept, enable);
 	}
 
+	// NOTE INT1 (arduino pin 13) is the only line wired to the main board
+	// ref https://github.com/tinyzero/tinyzero-TinyZero-ASM2021/blob/master/design_files/TinyZero_Schematic_Rev5.pdf
+	static constexpr const auto &int1 = port::extints::D13_PA17_EXTINT1;
+
+	// `cb` runs on the EIC interrupt and wakes the device from standby
+	// NOTE level sensing works without GCLK_EIC, edges are lost in standby;
+	//	a latched level keeps firing, `cb` has to `mask`, listening again
+	//	releases the latch and unmasks
+	// NOTE without `cb` the event is routed to INT1 with the interrupt off
+	//	(e.g. for the event system)
 	template <typename cb_type>
 	void listen(::bma250::event_e ev, cb_type cb, bool req_accept = false) {
-		// NOTE ~~only INT1 is attached to the main board~~
-		// ref https://github.com/tinyzero/tinyzero-TinyZero-ASM2021/blob/master/design_files/TinyZero_Schematic_Rev5.pdf
-		return base::listen(ev, ::bma250::interrupt_e::INT1, cb, req_accept);
+		base::listen(ev, ::bma250::interrupt_e::INT1, req_accept);
+
+		if (cb == nullptr) {
+			this->mask();
+			return;
+		}
+
+		this->attach(cb, HIGH);
+	}
+
+	// `mode` as for arduino's `attachInterrupt`
+	// NOTE pulses (e.g. non-latched data-ready) need an edge, standby disallowed then
+	template <typename cb_type>
+	void attach(cb_type cb, int mode) {
+		// NOTE a flag left by the previous mode (e.g. data-ready edges) would fire right away
+		int1.clear();
+		attachInterrupt(13, cb, mode);
+		int1.set_wakeup(true);
+	}
+
+	// stop INT1 from firing, safe from interrupt context
+	void mask() {
+		int1.set_interrupt(false);
 	}
 };
 
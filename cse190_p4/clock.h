@@ -19,6 +19,9 @@ class clock {
 protected:
 	struct clock_info info;
 
+	// NOTE shared by all generators: one counter per generic clock channel (CLKCTRL.ID, 6 bits)
+	static inline uint8_t refs_dev[1 << 6] = {};
+
 public:
 	enum srcid_e : uint32_t {
 		CLKSRCID_XOSC      = GCLK_GENCTRL_SRC_XOSC_Val,
@@ -50,9 +53,14 @@ public:
 	} src_info;
 
 	enum devid_e : uint16_t {
+		CLKDEVID_RTC     = GCLK_CLKCTRL_ID_RTC_Val,
 		CLKDEVID_SERCOM0 = GCLK_CLKCTRL_ID_SERCOM0_CORE_Val,
 		CLKDEVID_SERCOM3 = GCLK_CLKCTRL_ID_SERCOM3_CORE_Val,
 		CLKDEVID_TC3     = GCLK_CLKCTRL_ID_TCC2_TC3_Val,
+		CLKDEVID_TC4     = GCLK_CLKCTRL_ID_TC4_TC5_Val,
+		CLKDEVID_EIC     = GCLK_CLKCTRL_ID_EIC_Val,
+		CLKDEVID_EVSYS_0 = GCLK_CLKCTRL_ID_EVSYS_0_Val,
+		CLKDEVID_EVSYS_1 = GCLK_CLKCTRL_ID_EVSYS_1_Val,
 		// TODO implement rest
 	};
 
@@ -107,7 +115,10 @@ public:
 		return this->src_info.presets[this->get_src()].freq;
 	}
 
+	// NOTE reference counted, every `attach` needs a matching `detach`
 	clock &attach(enum devid_e id) {
+		this->refs_dev[id] += 1;
+
 		//this->info.clk->CLKCTRL.reg = GCLK_CLKCTRL_RESETVALUE;
 		auto &clkctrl = this->info.clk->CLKCTRL.bit;
 		clkctrl.ID = id;
@@ -118,7 +129,13 @@ public:
 		return *this;
 	}
 
+	// channel stays enabled while other users hold it
 	clock &detach(enum devid_e id) {
+		if (this->refs_dev[id] > 0)
+			this->refs_dev[id] -= 1;
+		if (this->refs_dev[id] > 0)
+			return *this;
+
 		//this->info.clk->CLKCTRL.reg = GCLK_CLKCTRL_RESETVALUE;
 		auto &clkctrl = this->info.clk->CLKCTRL.bit;
 		clkctrl.ID = id;
@@ -5,13 +5,18 @@ extern "C" void __libc_init_array(void);
 
 #include <tuple>
 #include <queue>
+#include <iterator>
 
 #include "utils.h"
 #include "logging.h"
 
 #include "clock.h"
 #include "timer.h"
+#include "rtc.h"
+#include "evsys.h"
 #include "bma250.h"
+#include "motion.h"
+#include "accl_trace.h"
 #include "stble.h"
 
 #include "pm.h"
@@ -21,7 +26,17 @@ static const constexpr bool
 	// production mode, debugging outputs disabled
 	production = true,
 	// only valid when production is false
-	wait_for_serial = false; 
+	wait_for_serial = false,
+	// I2C transaction tracing (see i2c_trace.h)
+	trace_i2c = !production,
+	// accelerometer sample streaming on data-ready instead of the slope interrupt
+	// NOTE keeps the device out of standby (edge-sensed interrupt, I2C traffic)
+	stream_accl = false,
+	// suspend the accelerometer while lost, lost is then only left through `found`
+	suspend_accl_when_lost = true,
+	// binary trace of the sample stream over USB serial (see accl_trace.h)
+	// NOTE only valid when streaming and production is false, mutes the logger on the port
+	record_accl = false;
 
 namespace privtag {
 
@@ -31,11 +46,13 @@ public:
 	
 	struct {
 		char *reset = "found";
+		char *stats = "stats";
 	} cmd;
 
 	struct {
 		callback_f *lost = nullptr,
-			*reset = nullptr;
+			*reset = nullptr,
+			*stats = nullptr;
 	} callbacks;
 	std::queue<callback_f *> callback_queue;
 
@@ -69,6 +86,12 @@ public:
 			this->cmd.reset, strlen(this->cmd.reset)
 		)) {
 			this->reset();
+		} else if (utils::bytes_equal(
+			cmd, len,
+			this->cmd.stats, strlen(this->cmd.stats)
+		)) {
+			if (this->callbacks.stats != nullptr)
+				this->callback_queue.push(this->callbacks.stats);
 		}
 	}
 
@@ -107,14 +130,13 @@ int main() {
 			while (!SerialUSB);
 	}
 
-	// TODO
 	// peripheral clock configuration
-	//PM->APBCMASK.reg = PM_APBCMASK_RESETVALUE;
-
-	PM->APBCMASK.bit.ADC_ = true;
-	PM->APBCMASK.bit.DAC_ = true;
-	PM->APBCMASK.bit.SERCOM3_ = true;
-	PM->APBCMASK.bit.TC3_ = true;
+	// NOTE drivers acquire the APB clocks they use, 
+	//	everything else arduino's `init` turned on is gated
+	static constexpr auto &pm = tinyzero::pms::pm0;
+	// BlueNRG SPI (SERCOM4, see variant.h)
+	pm.acquire(pm.APBC_SERCOM4);
+	pm.gate_unused();
 
 	// logging
 	static const constexpr auto log_level 
@@ -125,7 +147,8 @@ int main() {
 	static tinyzero::usbserial_logger logger("privtag");
 	// set USB serial baud rate
 	logger.init(115200);
-	logger.set_level(log_level);
+	// NOTE the port carries the sample trace alone when recording
+	logger.set_level(record_accl ? logging::L_NOTSET : log_level);
 
 	// out-of-band logging (USB serial unavail)
 	static tinyzero::led_logger logger_le("privtag_le");
@@ -147,28 +170,121 @@ int main() {
 	logger.info("i2c: initialization");
 	static constexpr auto &i2c = tinyzero::i2c_sockets::primary_sercom3;
 	// TODO baud rate
+	// NOTE enabled per bus-active window by the bus manager
 	i2c.init(&sysclk, 100000);
 
-	i2c.enable();
+	static i2c_trace::tracer i2c_tracer(
+		[]() -> uint32_t { return micros(); }
+	);
+	if (trace_i2c)
+		i2c.tracer = &i2c_tracer;
+
+	// shared bus, one handle per device
+	static constexpr auto &i2c_bus = tinyzero::i2c_buses::bus_sercom3;
 
 	// accelerometer
 	logger.info("accelerometer: initialization");
 	static constexpr auto &accel = tinyzero::accel;
 
-	accel.init(&i2c);
+	accel.init(i2c_bus.open({0x18}));
 	accel.set_range(bma250::range_preset_t::RANGE_2G)
-		.set_intvl(bma250::intvl_preset_t::INTVL_64MS)
-		.set_lopower(bma250::bma250::sleepdur_e::DUR_500MS);
+		.set_intvl(bma250::intvl_preset_t::INTVL_64MS);
+
+	// sensor power modes, revisited on every timer tick
+	// NOTE low-power sleep phases would throttle the data rate, normal mode when streaming
+	static bma250::power_policy accel_power(&accel);
+	accel_power.set_streaming(stream_accl).apply();
+
+	// sample stream, see `stream_accl` and the classification bursts
+	static const constexpr auto
+		stream_intvl = bma250::intvl_preset_t::INTVL_64MS;
+	static const constexpr uint8_t
+		stream_decimation = 1;
+	// update time of `stream_intvl`, the data-ready period
+	static const constexpr uint32_t
+		stream_ready_us = 64000;
+	static bma250::stream<64> accel_stream(&accel);
+	// ~2 s windows at the stream rate
+	static motion::classifier<32> motion_clf;
+
+	static accl_trace::encoder accel_rec(
+		[](const uint8_t *data, std::size_t len, void *_) {
+			SerialUSB.write(data, len);
+		}
+	);
+	// NOTE one tick per data-ready, see `bma250::sample_s::seq`
+	if (record_accl)
+		accel_rec.begin(stream_ready_us);
+
+	// idle timeout, see below
+	static constexpr auto &idle_timer = tinyzero::timers::tc4;
+	static constexpr auto &idle_channel = tinyzero::evsys_channels::ch0;
+
+	// latched slope interrupt on INT1, no bus traffic while stationary
+	// NOTE the ISR only records the event, the latch is released on the next tick
+	static volatile bool has_slope = false;
+	static auto on_slope = []() {
+		has_slope = true;
+		accel.mask();
+	};
+
+	// classification bursts: a slope event streams samples to the classifier
+	//	until it calls the device moving or `burst_windows` windows are classified,
+	//	the slope interrupt takes over again then
+	// NOTE a slope event alone is no motion, vibration raises them all the time
+	static const constexpr std::size_t
+		burst_windows = 4;
+	static bool is_bursting = false;
+	static std::size_t burst_n_windows = 0, burst_n_ticks = 0;
+
+	static auto start_burst = []() {
+		// NOTE data-ready edges on INT1 are no motion, off the idle timer
+		idle_channel.route(0, idle_timer.event_user());
+		accel.listen(bma250::event_e::SLOPE, false, false);
+		accel_stream.start(stream_intvl, stream_decimation);
+		accel.attach([]() { accel_stream.on_data_ready(); }, RISING);
+
+		motion_clf.reset();
+		burst_n_windows = burst_n_ticks = 0;
+		is_bursting = true;
+	};
+	// slope edges restart the idle timer only while the device is moving,
+	//	vibration would keep it from ever expiring otherwise
+	static auto stop_burst = [](bool moving) {
+		accel_stream.stop();
+		accel.listen(bma250::event_e::SLOPE, on_slope, true);
+		idle_channel.route(moving ? accel.int1.evgen() : 0, idle_timer.event_user());
+		is_bursting = false;
+	};
 
-	// TODO latch mode not working!!!
-	accel.listen(bma250::event_e::SLOPE, true);
+	if (stream_accl) {
+		accel_stream.start(stream_intvl, stream_decimation);
+		accel.attach([]() { accel_stream.on_data_ready(); }, RISING);
+	} else {
+		accel.listen(bma250::event_e::SLOPE, on_slope, true);
+	}
 
-	// NOTE using polling instead of interrupt 
 	static auto check_movement = []() -> bool {
-		auto stat = bma250_register_read(&accel, intt_stat.intt);
-		accel.accept();
+		// NOTE the classifier filters out vibration a slope event would count
+		if (stream_accl)
+			return motion_clf.is_moving();
+
+		if (is_bursting) {
+			bool moving = motion_clf.is_moving();
+			// NOTE ticks bound a burst the samples stop coming to (e.g. suspended)
+			if (moving || burst_n_windows >= burst_windows
+				|| ++burst_n_ticks > burst_windows + 1)
+				stop_burst(moving);
+			return moving;
+		}
 
-		return stat.slope_int;
+		if (!has_slope)
+			return false;
+
+		// verdict on a later tick
+		has_slope = false;
+		start_burst();
+		return false;
 	};
 
 	// privtag app
@@ -228,6 +344,13 @@ int main() {
 		app.process_cmd(data, len);
 	};
 
+	bt_uart.callbacks.write_failed = [](tBleStatus status) {
+		logger.error(
+			std::string("bluetooth (UART): write failure: ")
+				+ std::to_string(status)
+		);
+	};
+
 	if (bt_uart.init(bt_uart_i) != bt_uart.STATUS_SUCCESS) {
 		logger.error("bluetooth (UART): init failure");
 		return EXIT_FAILURE;
@@ -240,16 +363,14 @@ int main() {
 
 	app.callbacks.reset = [](privtag::privtag *_) {
 		logger.debug("privtag: exiting lost state");
-		bt_uart.close();
-		bt.unset_discoverable();
-		bt.standby();
+		// NOTE completed in the main loop
+		bt_uart.close_async();
+		bt.unset_discoverable_async();
+		bt.standby_async();
 	};
 
 	app.reset();
 
-	// timer
-	// TODO rm when bma250 interrupt can be latched
-
 	// how long it takes before declaring device lost
 	static const constexpr std::size_t
 		idle_interval_sec = 2,
@@ -260,6 +381,8 @@ int main() {
 
 	// timer
 	static volatile bool stat_interrupt = false;
+	// NOTE the tick work runs in the main loop, see `on_tick`
+	static volatile bool tick_interrupt = false;
 
 	logger.info("timer: initialization");
 	static constexpr auto &timer = tinyzero::timers::tc3;
@@ -274,9 +397,47 @@ int main() {
 		return EXIT_FAILURE;
 	}
 
+	// idle timeout: motion restarts the count, a match means no motion for a whole period
+	// NOTE the classifier verdict is sent as a software event; once moving,
+	//	slope edges restart it through the event system too, without the CPU
+	vendor_samd::evsys::init(&pm);
+	idle_timer.init(&clk);
+
+	if (idle_timer.set_interval(
+		idle_timeout_sec, 
+		idle_timer.INTVLPRIOR_RANGE
+	) != idle_timer.STATUS_SUCCESS) {
+		logger.error("timer: invalid idle timeout");
+		return EXIT_FAILURE;
+	}
+
+	idle_timer.set_event_input(idle_timer.EVACT_RETRIGGER);
+	// NOTE the generator is connected by `stop_burst`
+	idle_channel.route(0, idle_timer.event_user());
+	if (!stream_accl)
+		accel.int1.set_event_output(true);
+
+	idle_timer.listen([]() {
+		logger.debug(
+			std::string("timer: idle timeout: ")
+				+ "duration = " + std::to_string(idle_timeout_sec) + "sec"
+		);
+
+		if (app.is_lost)
+			app.n_minutes_lost += idle_timeout_sec / 60;
+
+		app.set_lost();
+	});
+
 	timer.listen([]() {
+		tick_interrupt = true;
+	});
+
+	// movement check and sensor power mode, from the main loop
+	// NOTE both talk to the BMA250 synchronously: from the ISR, a tick landing in
+	//	the main loop's `i2c_bus.process` would get `ST_LOCKED` and lose the writes
+	static auto on_tick = []() {
 		static std::size_t n_seconds = 0;
-		static bool has_movement = false;
 
 		logger.debug(
 			std::string("timer: tick: ")
@@ -287,42 +448,39 @@ int main() {
 		n_seconds += idle_interval_sec;
 
 		// check movement
-		if (check_movement()) {
-			has_movement = true;
+		bool motion = check_movement();
+		if (motion) {
+			// see `idle_timer`
+			idle_channel.trigger();
+			// NOTE the idle timer only declares the device lost, motion brings it back
+			if (app.is_lost)
+				app.reset();
 			logger.debug("timer: movement check: motion");
 			logger_le.debug("timer: movement check: motion");
 		} else {
 			logger_le.debug("");
 		}
 
-		// stats
-		if (n_seconds % stat_interval_sec == 0) {
-			stat_interrupt = true;
-		}
-
-		// idle timeout
-		if (n_seconds % idle_timeout_sec == 0) {
+		// sensor power mode, on the wake-up the MCU takes anyway
+		if (accel_power
+			.set_streaming(stream_accl || is_bursting)
+			.set_suspended(suspend_accl_when_lost && app.is_lost)
+			.on_tick(idle_interval_sec * 1000, motion)
+			.apply()
+		) {
 			logger.debug(
-				std::string("timer: idle timeout: ")
-					+ "duration = " + std::to_string(idle_timeout_sec) + "sec, "
-					+ "movement = " + std::to_string(has_movement)
+				std::string("accelerometer: power: ")
+					+ std::string(accel_power)
 			);
+		} else if (!accel_power.applied()) {
+			logger.error("accelerometer: power: write failure");
+		}
 
-			if (app.is_lost)
-				app.n_minutes_lost += idle_timeout_sec / 60;
-
-			// enter/exit lost mode
-			if (!has_movement) {
-				app.set_lost();
-			} else {
-				app.reset();
-			}
-
-			// reset status
-			n_seconds = 0;
-			has_movement = false;
+		// stats
+		if (n_seconds % stat_interval_sec == 0) {
+			stat_interrupt = true;
 		}
-	});
+	};
 
 	/*
 	// how long it takes before declaring device lost
@@ -376,26 +534,171 @@ int main() {
 	});
 	*/
 
-	// timer enabled in standby
+	// timers enabled in standby
 	timer.enable(true);
+	idle_timer.enable(true);
+
+	// sleep-mode governor
+	static vendor_samd::governor gov;
+	// NOTE production never attaches USB, keep it down instead of reattaching on every wake-up
+	static constexpr auto &standby = tinyzero::pms::standby0;
+	standby.set_usb_policy(
+		production
+			? standby.USB_DETACHED
+			: standby.USB_FOLLOW
+	);
+	gov.standby_p = &standby;
+
+	// wake-up source tracing, standby and idle modes
+	// NOTE timebase is the RTC at 32 kHz: SysTick stops in standby,
+	//	the TC counts are too coarse and need a read synchronization
+	// NOTE SysTick wakes the idle modes every 1 ms
+	static constexpr auto &rtc = tinyzero::rtcs::rtc0;
+	rtc.init(&clk).enable();
+
+	static const char *const wake_names[] = {
+		"tc3", "tc4", "bluenrg", "bma250", "usb", "systick"
+	};
+	static const vendor_samd::standby_path::wake_source_s wake_sources[] = {
+		{ TC3_IRQn, 0 },
+		{ TC4_IRQn, 0 },
+		{ EIC_IRQn, tinyzero::port::extints::D2_PA14_EXTINT14.mask() },
+		{ EIC_IRQn, tinyzero::port::extints::D13_PA17_EXTINT1.mask() },
+		{ USB_IRQn, 0 },
+		{ SysTick_IRQn, 0 }
+	};
+	static wake_trace::tracer wake_tracer(
+		[]() -> uint32_t { return rtc.get_count(); },
+		rtc.get_tick_freq(),
+		0,
+		wake_names, std::size(wake_names)
+	);
+	standby.set_wake_trace(
+		&wake_tracer, 
+		wake_sources, std::size(wake_sources)
+	);
+
+	// NOTE set once the tracers exist
+	app.callbacks.stats = [](privtag::privtag *_) {
+		auto report = [](const std::string &s) {
+			logger.info(s);
+			if (bt_uart.print_async(s) != bt_uart.STATUS_SUCCESS)
+				logger.error("bluetooth (UART): stat transmission failure");
+		};
+
+		report(std::string("wake: ") + std::string(wake_tracer));
+		if (trace_i2c)
+			report(std::string("i2c: ") + std::string(i2c_tracer.stats()));
+	};
+
+	gov.deadline_f = []() -> std::size_t {
+		return std::min(
+			timer.get_time_to_match_us(),
+			idle_timer.get_time_to_match_us()
+		);
+	};
+	gov.pending_f = []() -> bool {
+		return stat_interrupt
+			|| tick_interrupt
+			|| i2c_bus.pending() != 0
+			|| !accel_stream.empty()
+			|| !app.callback_queue.empty()
+			|| !HCI_Queue_Empty()
+			|| BlueNRG_DataPresent();
+	};
 
 	// main loop
 	while (true) {
-		if (!app.is_lost) {
-			vendor_samd::standby();
+		// NOTE the BlueNRG IRQ is edge-sensed on a clock that stops in standby
+		// NOTE deferred BlueNRG writes are retried on the tick, which stops in standby
+		gov.allow_standby(
+			!app.is_lost 
+			&& accel_power.allows_standby() 
+			&& HCI_Write_Pending() == 0
+		);
+		gov.sleep();
+
+		// I2C transactions queued by interrupts (e.g. the data-ready burst read)
+		i2c_bus.process();
+
+		// NOTE classification bursts start and stop here, see `check_movement`
+		if (tick_interrupt) {
+			tick_interrupt = false;
+			on_tick();
 		}
 
 		app.process();
 		stble::process();
 
+		// accelerometer samples, in batches
+		if (stream_accl || is_bursting) {
+			static bma250::sample_s batch[16];
+			std::size_t n = accel_stream.read(batch, std::size(batch));
+			// data-ready count, unwrapped
+			static uint32_t t_ready = 0;
+			static uint16_t seq_prev = 0;
+			for (std::size_t i = 0; i < n; i++) {
+				const auto &b = batch[i];
+				t_ready += (uint16_t)(b.seq - seq_prev);
+				seq_prev = b.seq;
+				// NOTE raw 0x09 recorded whenever an interrupt is flagged
+				if (record_accl)
+					accel_rec.push(t_ready, b.x(), b.y(), b.z(), 
+						b.intt != 0, b.intt);
+
+				if (!motion_clf.push(b.x(), b.y(), b.z()))
+					continue;
+
+				burst_n_windows += 1;
+				logger.debug(
+					std::string("motion: ")
+						+ motion::to_string(motion_clf.get_class()) + ": "
+						+ std::string(motion_clf.features())
+				);
+			}
+			if (record_accl)
+				accel_rec.flush();
+		}
+
 		if (stat_interrupt) {
+			if (trace_i2c) {
+				logger.debug(
+					std::string("i2c: stats: ")
+						+ std::string(i2c_tracer.stats())
+				);
+			}
+			logger.debug(
+				std::string("bluetooth (HCI): stats: ")
+					+ std::string(stble::hci_stats())
+			);
+			logger.debug(
+				std::string("bluetooth (HCI): async: ")
+					+ std::string(stble::async_stats)
+			);
+			logger.debug(
+				std::string("pm: standby: ")
+					+ std::string(standby.cost())
+			);
+			logger.debug(
+				std::string("pm: wake: ")
+					+ std::string(wake_tracer)
+			);
+			logger.debug(
+				std::string("accelerometer: stream: ")
+					+ std::string(accel_stream.stats())
+			);
+			logger.debug(
+				std::string("motion: windows: ")
+					+ std::string(motion_clf.stats())
+			);
+
 			if (app.is_lost) {
 				logger.info(
 					std::string("privtag: stats: ")
 						+ app.stats()
 				);
 
-				if (bt_uart.print(
+				if (bt_uart.print_async(
 					std::string(app.name) + ":"
 						+ std::to_string(app.n_minutes_lost)
 				) != bt_uart.STATUS_SUCCESS)
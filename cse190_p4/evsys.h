@@ -0,0 +1,110 @@
+#pragma once
+
+#include <samd.h>
+
+#include "clock.h"
+#include "pm.h"
+
+
+// SAMD21 event system abstraction
+// 24. EVSYS – Event System
+// peripherals signal each other directly, the CPU stays asleep
+namespace vendor_samd {
+class evsys {
+public:
+	// 24.6.2.6 Channel Path Selection
+	enum path_e : uint32_t {
+		PATH_SYNC   = EVSYS_CHANNEL_PATH_SYNCHRONOUS_Val,
+		PATH_RESYNC = EVSYS_CHANNEL_PATH_RESYNCHRONIZED_Val,
+		// NOTE no GCLK_EVSYS_CHANNEL_n needed, works in standby
+		PATH_ASYNC  = EVSYS_CHANNEL_PATH_ASYNCHRONOUS_Val
+	};
+
+	// NOTE only effective on the (re)synchronized paths
+	enum edge_e : uint32_t {
+		EDGE_NONE    = EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT_Val,
+		EDGE_RISING  = EVSYS_CHANNEL_EDGSEL_RISING_EDGE_Val,
+		EDGE_FALLING = EVSYS_CHANNEL_EDGSEL_FALLING_EDGE_Val,
+		EDGE_BOTH    = EVSYS_CHANNEL_EDGSEL_BOTH_EDGES_Val
+	};
+
+	static void init(pm *pwr) {
+		pwr->acquire(pm::apbc_e::APBC_EVSYS);
+	}
+
+	static void deinit(pm *pwr) {
+		pwr->release(pm::apbc_e::APBC_EVSYS);
+	}
+
+	class channel {
+	protected:
+		uint8_t id;
+
+	public:
+		constexpr channel(uint8_t id) : id(id) {}
+
+		// generator (e.g. `extint::evgen()`) to user (e.g. `timer::event_user()`)
+		// NOTE (re)synchronized paths need the channel clock, see `clock::attach`
+		const channel &route(
+			uint8_t gen, uint8_t user,
+			enum path_e path = path_e::PATH_ASYNC,
+			enum edge_e edge = edge_e::EDGE_NONE
+		) const {
+			this->add_user(user);
+
+			// NOTE CHANNEL is written at once, ID selects the channel
+			EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(this->id)
+				| EVSYS_CHANNEL_EVGEN(gen)
+				| EVSYS_CHANNEL_PATH(path)
+				| EVSYS_CHANNEL_EDGSEL(edge);
+			return *this;
+		}
+
+		// 24.8.3 User Multiplexer: CHANNEL holds channel number + 1, 0 = none
+		const channel &add_user(uint8_t user) const {
+			EVSYS->USER.reg = EVSYS_USER_USER(user)
+				| EVSYS_USER_CHANNEL(this->id + 1);
+			return *this;
+		}
+
+		const channel &remove_user(uint8_t user) const {
+			EVSYS->USER.reg = EVSYS_USER_USER(user)
+				| EVSYS_USER_CHANNEL(0);
+			return *this;
+		}
+
+		const channel &detach() const {
+			EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(this->id)
+				| EVSYS_CHANNEL_EVGEN(0);
+			return *this;
+		}
+
+		// software event
+		// NOTE half-word write keeps EVGEN/PATH/EDGSEL of the channel
+		const channel &trigger() const {
+			((volatile uint16_t *)&EVSYS->CHANNEL.reg)[0] 
+				= EVSYS_CHANNEL_CHANNEL(this->id) | EVSYS_CHANNEL_SWEVT;
+			return *this;
+		}
+
+		// 24.8.5 Channel Status
+		// NOTE meaningful on the (re)synchronized paths only
+		bool is_ready() const {
+			const uint32_t bit = 1ul << (this->id % 8);
+			const uint32_t shift = (this->id / 8) * 16;
+			auto &chstatus = EVSYS->CHSTATUS.reg;
+
+			return (chstatus & (bit << shift))							// USRRDYn
+				&& !(chstatus & (bit << (shift + EVSYS_CHSTATUS_CHBUSY0_Pos)));	// CHBUSYn
+		}
+	};
+};
+}
+
+namespace tinyzero {
+namespace evsys_channels {
+inline constexpr vendor_samd::evsys::channel
+	ch0(0),
+	ch1(1);
+}
+}
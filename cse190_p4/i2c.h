@@ -9,6 +9,8 @@
 
 #include "clock.h"
 #include "port.h"
+#include "pm.h"
+#include "i2c_trace.h"
 
 
 // SAMD21 I2C controller abstraction
@@ -20,12 +22,49 @@ struct i2c_info {
 	enum clock::devid_e clkid;	// clock ID
 	IRQn_Type irqn;				// IRQ number
 	port *port_sda, *port_scl;	// port: SDA (data), SCL (clock)
+	pm *pwr;					// power manager
+	enum pm::apbc_e apbcid;		// APB clock ID
+};
+
+// I2C status
+enum i2c_status : uint8_t {
+	ST_SUCCESS = 0,
+	ST_TOOLONG = 1,
+	ST_NACK_ADDR = 2,
+	ST_NACK_DATA = 3,
+	ST_OTHER = 4,
+	ST_TIMEOUT = 5,		// wait bound exceeded
+	ST_BUSERR = 6,		// misplaced START/STOP
+	ST_ARBLOST = 7,		// arbitration lost
+	ST_LOWTOUT = 8,		// SCL held low for too long
+	ST_LOCKED = 9		// bus held by an interrupted context
 };
 
 class i2c_common {
 protected:
+	using status_e = i2c_status;
+
 	struct i2c_info info;
 
+	clock *clk = nullptr;
+
+	// bus-active windows, see `open`
+	std::size_t n_open = 0;
+
+	void acquire_clocks() {
+		this->info.pwr->acquire(this->info.apbcid);
+		this->clk->attach(this->info.clkid);
+	}
+
+	void release_clocks() {
+		this->clk->detach(this->info.clkid);
+		this->info.pwr->release(this->info.apbcid);
+	}
+
+	// NOTE upper bound of polling iterations per wait
+	// a wait that runs out is reported as `status_e::ST_TIMEOUT`
+	std::size_t timeout = timeout_default;
+
 	// NOTE I2CM and I2CS share the same set of registers
 	static constexpr SercomI2cm *
 	common_of(Sercom *s) { return &s->I2CM; }
@@ -43,13 +82,25 @@ public:
 		EV_SWRESET
 	};
 
+	// NOTE ~16k iterations span a few ms @ 48 MHz, well past one byte @ 100 kHz
+	static const constexpr std::size_t timeout_default = 1 << 14;
+
 	i2c_common(const struct i2c_info &info) : info(info) {}
 
-	i2c_common &init(clock *clk) {
-		this->reset();
+	// NOTE worst-case latency of a transaction is bounded by 
+	// (number of waits) * `timeout` iterations + one `recover()`
+	i2c_common &set_timeout(std::size_t n_iters) {
+		this->timeout = n_iters;
+		return *this;
+	}
 
+	// NOTE clocks stay on until the derived `init` is done, see `init_done`
+	i2c_common &init(clock *clk) {
 		// configure clock
-		clk->attach(this->info.clkid);
+		this->clk = clk;
+		this->acquire_clocks();
+
+		this->reset();
 
 		// configure port IO type
 		for (auto *p : {
@@ -81,6 +132,31 @@ public:
 		return *this;
 	}
 
+	// configuration done, gate until the first window
+	i2c_common &init_done() {
+		this->release_clocks();
+		return *this;
+	}
+
+	// bus-active window: APB/GCLK clocks and the SERCOM are on only while open
+	i2c_common &open() {
+		if (this->n_open++ > 0)
+			return *this;
+		this->acquire_clocks();
+		this->enable();
+		return *this;
+	}
+
+	i2c_common &close() {
+		if (this->n_open == 0)
+			return *this;
+		if (--this->n_open > 0)
+			return *this;
+		this->disable();
+		this->release_clocks();
+		return *this;
+	}
+
 	i2c_common &enable() {
 		common_of(this->info.ser)->CTRLA.bit.ENABLE = true;
 		this->wait_sync(event_e::EV_ENABLE);		
@@ -105,9 +181,9 @@ public:
 	// 28.10.8 Synchronization Busy
 	// SYSOP (event_e::EV_SYSOP): (when enabled) CTRLB.CMD, STATUS.BUSSTATE, ADDR, DATA
 	// ENABLE (event_e::EV_ENABLE): CTRLA.ENABLE
-	i2c_common &wait_sync(enum event_e ev = event_e::EV_ANY) {
+	status_e wait_sync(enum event_e ev = event_e::EV_ANY) {
 		bool is_busy = false;
-		while (true) {
+		for (std::size_t n = 0; n < this->timeout; n++) {
 			auto &s = common_of(this->info.ser)->SYNCBUSY;
 
 			switch (ev) {
@@ -126,8 +202,76 @@ public:
 			}
 
 			if (!is_busy)
-				break;
+				return status_e::ST_SUCCESS;
 		}
+		return status_e::ST_TIMEOUT;
+	}
+
+	// 28.10.7 Status
+	// NOTE error flags stay set until cleared by software
+	status_e check_error() {
+		auto *c = common_of(this->info.ser);
+
+		status_e s = status_e::ST_SUCCESS;
+		if (c->STATUS.bit.BUSERR) s = status_e::ST_BUSERR;
+		else if (c->STATUS.bit.ARBLOST) s = status_e::ST_ARBLOST;
+		else if (c->STATUS.bit.LOWTOUT) s = status_e::ST_LOWTOUT;
+
+		if (s != status_e::ST_SUCCESS) {
+			// writing one clears the flag, BUSSTATE is left untouched
+			c->STATUS.reg = SERCOM_I2CM_STATUS_BUSERR
+				| SERCOM_I2CM_STATUS_ARBLOST
+				| SERCOM_I2CM_STATUS_LOWTOUT;
+			c->INTFLAG.reg = SERCOM_I2CM_INTFLAG_ERROR;
+		}
+
+		return s;
+	}
+
+	// wait for any of the interrupt flags in `mask` (or an error)
+	status_e wait_flag(uint8_t mask) {
+		auto &intflag = common_of(this->info.ser)->INTFLAG;
+		for (std::size_t n = 0; n < this->timeout; n++) {
+			if (intflag.reg & (mask | SERCOM_I2CM_INTFLAG_ERROR))
+				return this->check_error();
+		}
+		return status_e::ST_TIMEOUT;
+	}
+
+	// bus clear
+	// NOTE ref https://www.nxp.com/docs/en/user-guide/UM10204.pdf
+	// 3.1.16 Bus clear
+	/* "If the data line (SDA) is stuck LOW, the master should send nine clock pulses.
+		The device that held the bus LOW should release it sometime within those nine clocks." */
+	i2c_common &recover() {
+		this->disable();
+
+		auto *sda = this->info.port_sda;
+		auto *scl = this->info.port_scl;
+
+		// open-drain emulation: input (pulled up) = HIGH, output (driven low) = LOW
+		for (auto *p : {sda, scl})
+			p->unset_mux().set_low().set_input();
+
+		// NOTE half periods of 5 us ~ 100 kHz
+		for (std::size_t i = 0; i < 9; i++) {
+			scl->set_output();
+			delayMicroseconds(5);
+			scl->set_input();
+			delayMicroseconds(5);
+		}
+
+		// STOP: SDA rises while SCL is high
+		sda->set_output();
+		delayMicroseconds(5);
+		sda->set_input();
+		delayMicroseconds(5);
+
+		for (auto *p : {sda, scl})
+			p->set_mux(port_type_e::PTYPE_C_SERCOM);
+
+		// NOTE `enable` forces the bus state back to idle
+		this->enable();
 		return *this;
 	}
 
@@ -156,15 +300,6 @@ union i2c_address {
 	uint8_t addr7;
 };
 
-// I2C status
-enum i2c_status : uint8_t {
-	ST_SUCCESS = 0,
-	ST_TOOLONG = 1,
-	ST_NACK_ADDR = 2,
-	ST_NACK_DATA = 3,
-	ST_OTHER = 4
-};
-
 // I2C primary mode
 class i2c_primary : public i2c_common {
 protected:
@@ -178,18 +313,36 @@ public:
 
 	using base::i2c_common;
 
-	i2c_primary &init(clock *clk, uint8_t baudrate) {
+	// 28.10.1 CTRLA.INACTOUT: bus inactivity time-out
+	enum inactout_e : uint32_t {
+		INACTOUT_DIS = 0x0,
+		INACTOUT_55US = 0x1,	// 5-6 SCL cycles @ 100 kHz
+		INACTOUT_105US = 0x2,	// 10-11 SCL cycles @ 100 kHz
+		INACTOUT_205US = 0x3	// 20-21 SCL cycles @ 100 kHz
+	};
+
+	i2c_primary &init(
+		clock *clk, uint8_t baudrate,
+		enum inactout_e inactout = inactout_e::INACTOUT_205US
+	) {
 		// configure clock
 		this->base::init(clk);
 
 		// configure as primary
 		this->set_mode(base::mode_e::MODE_PRIM);
+
+		// time-outs: SCL held low for 25-35 ms, bus idle while owned
+		auto &ctrla = this->info.ser->I2CM.CTRLA.bit;
+		ctrla.LOWTOUTEN = true;
+		ctrla.INACTOUT = inactout;
 		// set baud rate
 		this->info.ser->I2CM.BAUD.bit.BAUD = baudrate;
 
 		// TODO smart mode
 		this->info.ser->I2CM.CTRLB.bit.SMEN = this->smart;
 
+		this->base::init_done();
+
 		return *this;
 	}
 
@@ -221,20 +374,17 @@ public:
 		CMD_STOP = 3
 	};
 
-	i2c_primary &send_cmd(enum cmd_e cmd) {
+	status_e send_cmd(enum cmd_e cmd) {
 		this->info.ser->I2CM.CTRLB.bit.CMD = cmd;
-		this->wait_sync(base::event_e::EV_SYSOP);
-		return *this;
+		return this->wait_sync(base::event_e::EV_SYSOP);
 	}
 
-	i2c_primary &wait_write_avail() {
-		while (!this->info.ser->I2CM.INTFLAG.bit.MB);
-		return *this;
+	status_e wait_write_avail() {
+		return this->wait_flag(SERCOM_I2CM_INTFLAG_MB);
 	}
 
-	i2c_primary &wait_read_avail() {
-		while (!this->info.ser->I2CM.INTFLAG.bit.SB);
-		return *this;
+	status_e wait_read_avail() {
+		return this->wait_flag(SERCOM_I2CM_INTFLAG_SB);
 	}
 
 	status_e set_addr_sync(const union i2c_address &addr, bool is_read) {
@@ -246,12 +396,17 @@ public:
 		};
 		// NOTE FIXME 10-bit mode?
 		this->info.ser->I2CM.ADDR.bit.ADDR = hdr.raw7;
-		this->wait_sync(event_e::EV_SYSOP);
 
-		if (is_read) this->wait_read_avail();
-		else this->wait_write_avail();
+		status_e s = this->wait_sync(event_e::EV_SYSOP);
+		if (s != status_e::ST_SUCCESS)
+			return s;
 
-		// TODO error checking
+		// NOTE a NACKed read address sets MB instead of SB
+		s = this->wait_flag(
+			SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB
+		);
+		if (s != status_e::ST_SUCCESS)
+			return s;
 
 		// NACK received
 		if (this->info.ser->I2CM.STATUS.bit.RXNACK)
@@ -262,9 +417,10 @@ public:
 
 	status_e send_data_sync(const char &data) {
 		this->info.ser->I2CM.DATA.bit.DATA = data;
-		this->wait_write_avail();
 
-		// TODO error checking
+		status_e s = this->wait_write_avail();
+		if (s != status_e::ST_SUCCESS)
+			return s;
 
 		// NACK received
 		if (this->info.ser->I2CM.STATUS.bit.RXNACK)
@@ -274,20 +430,25 @@ public:
 	}
 
 	status_e recv_data_sync(char &data) {
-		this->wait_read_avail();
-		data = this->info.ser->I2CM.DATA.bit.DATA;
+		status_e s = this->wait_read_avail();
+		if (s != status_e::ST_SUCCESS)
+			return s;
 
-		// TODO error checking
+		data = this->info.ser->I2CM.DATA.bit.DATA;
 
 		return status_e::ST_SUCCESS;
 	}
 
 	status_e recv_data_sync(char *data, std::size_t len, std::size_t &rlen) {
 		// NOTE read ack read ack ... read nack
-		for (rlen; rlen <= len; ) {
+		while (rlen < len) {
 			// first read?
 			if (rlen == 0) /* noop: already has data */;
-			else this->send_cmd(cmd_e::CMD_READ);
+			else {
+				status_e s = this->send_cmd(cmd_e::CMD_READ);
+				if (s != status_e::ST_SUCCESS)
+					return s;
+			}
 
 			status_e s = this->recv_data_sync(data[rlen]);
 
@@ -303,6 +464,23 @@ public:
 
 		return status_e::ST_SUCCESS;
 	}
+
+	// release the bus after a transaction
+	// NACK: regular STOP, bus fault or time-out: clear the bus
+	status_e finish(status_e s) {
+		switch (s) {
+		case status_e::ST_SUCCESS:
+		case status_e::ST_NACK_ADDR:
+		case status_e::ST_NACK_DATA:
+			if (this->send_cmd(cmd_e::CMD_STOP) == status_e::ST_SUCCESS)
+				break;
+			// fallthrough
+		default:
+			this->recover();
+			break;
+		}
+		return s;
+	}
 };
 
 namespace i2c_socket {
@@ -313,9 +491,24 @@ protected:
 
 	i2c_address addr;
 
+	void trace(uint32_t t_start, i2c_trace::dir_e dir, std::size_t len) {
+		if (this->tracer == nullptr)
+			return;
+		this->tracer->end(
+			t_start,
+			this->addr.addr7, dir, len,
+			this->status,
+			this->status == status_e::ST_NACK_ADDR
+				|| this->status == status_e::ST_NACK_DATA
+		);
+	}
+
 public:
 	status_e status = status_e::ST_SUCCESS;
 
+	// optional instrumentation, nullptr: disabled
+	i2c_trace::tracer *tracer = nullptr;
+
 	primary(const struct i2c_info &info) : addr({}), base(info) {}
 
 	primary &init(clock *clk, uint8_t baudrate) {
@@ -329,51 +522,279 @@ public:
 	}
 
 	std::size_t send(const void *data_, std::size_t len) {
+		uint32_t t_start = this->tracer != nullptr ? this->tracer->begin() : 0;
 		std::size_t slen = 0;
 
 		auto *data = (const char *)data_;
 
 		this->status = this->base::set_addr_sync(this->addr, false);
-		if (this->status != status_e::ST_SUCCESS)
-			return slen;
 
-		if (data != nullptr) {
-			for (slen; slen <= len; slen += 1) {
+		if (this->status == status_e::ST_SUCCESS && data != nullptr) {
+			for (; slen < len; slen += 1) {
 				this->status = this->base::send_data_sync(data[slen]);
 				if (this->status != status_e::ST_SUCCESS)
-					return slen;
+					break;
 			}
 		}
 
-		this->base::send_cmd(
-			i2c_primary::CMD_STOP
-		);
+		this->base::finish(this->status);
+		this->trace(t_start, i2c_trace::DIR_WRITE, slen);
 
 		return slen;
 	}
 
 	std::size_t recv(void *data, std::size_t len) {
+		uint32_t t_start = this->tracer != nullptr ? this->tracer->begin() : 0;
 		std::size_t rlen = 0;
 
 		this->status = this->base::set_addr_sync(this->addr, true);
-		if (this->status != status_e::ST_SUCCESS)
-			return rlen;
 
-		this->status = this->base::recv_data_sync(
-			(char *)data, len,
-			rlen
-		);
-		if (this->status != status_e::ST_SUCCESS)
-			return rlen;
+		if (this->status == status_e::ST_SUCCESS) {
+			this->status = this->base::recv_data_sync(
+				(char *)data, len,
+				rlen
+			);
+		}
 
-		this->base::send_cmd(
-			i2c_primary::CMD_STOP
-		);
+		this->base::finish(this->status);
+		this->trace(t_start, i2c_trace::DIR_READ, rlen);
 
 		return rlen;
 	}
 };
 }
+
+// shared I2C bus
+// hands out per-device handles on top of one primary socket
+namespace i2c_bus {
+using status_e = i2c_status;
+
+// write `tx` then read `rx`, either part may be empty
+// NOTE both empty: address probe
+struct transaction {
+	i2c_address addr;
+	const void *tx;
+	std::size_t tx_len;
+	void *rx;
+	std::size_t rx_len;
+
+	// completion callback (optional), called from the context that drained the queue
+	void (*cb)(const struct transaction &, status_e) = nullptr;
+	void *data = nullptr;
+};
+
+class manager {
+public:
+	static const constexpr std::size_t
+		device_cap = 4,
+		queue_cap = 8;
+
+	// per-device handle
+	// NOTE same interface as `i2c_socket::primary` so drivers can take either
+	class device {
+	protected:
+		manager *bus = nullptr;
+		i2c_address addr = {};
+
+	public:
+		status_e status = status_e::ST_SUCCESS;
+
+		device() {}
+
+		device(manager *bus, const i2c_address &addr)
+			: bus(bus), addr(addr) {}
+
+		device &connect(const i2c_address &addr) {
+			this->addr = addr;
+			return *this;
+		}
+
+		std::size_t send(const void *data, std::size_t len) {
+			std::size_t slen = 0;
+			this->status = this->bus->transfer(
+				(struct transaction) {
+					.addr = this->addr,
+					.tx = data, .tx_len = len,
+					.rx = nullptr, .rx_len = 0
+				},
+				&slen, nullptr
+			);
+			return slen;
+		}
+
+		std::size_t recv(void *data, std::size_t len) {
+			std::size_t rlen = 0;
+			this->status = this->bus->transfer(
+				(struct transaction) {
+					.addr = this->addr,
+					.tx = nullptr, .tx_len = 0,
+					.rx = data, .rx_len = len
+				},
+				nullptr, &rlen
+			);
+			return rlen;
+		}
+
+		// queue a transaction, safe from interrupt context
+		// NOTE buffers must stay valid until `cb` is called
+		status_e submit(
+			const void *tx, std::size_t tx_len,
+			void *rx, std::size_t rx_len,
+			void (*cb)(const struct transaction &, status_e) = nullptr,
+			void *data = nullptr
+		) {
+			return this->bus->submit((struct transaction) {
+				.addr = this->addr,
+				.tx = tx, .tx_len = tx_len,
+				.rx = rx, .rx_len = rx_len,
+				.cb = cb, .data = data
+			});
+		}
+	};
+
+protected:
+	i2c_socket::primary *io;
+
+	device devices[device_cap];
+	std::size_t n_devices = 0;
+
+	volatile bool busy = false;
+
+	// NOTE multiple producers (main, ISRs), consumed by the lock holder only
+	struct transaction queue[queue_cap];
+	volatile std::size_t q_head = 0, q_tail = 0;
+
+	// critical section: PRIMASK saved and restored
+	template <typename fn_type>
+	static auto atomic(fn_type fn) {
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		auto res = fn();
+		__set_PRIMASK(primask);
+		return res;
+	}
+
+	// take the bus and open a bus-active window
+	bool lock() {
+		bool locked = atomic([this]() {
+			if (this->busy)
+				return false;
+			this->busy = true;
+			return true;
+		});
+		if (locked)
+			this->io->open();
+		return locked;
+	}
+
+	// run everything queued while the bus was held, close the window, then unlock
+	void unlock() {
+		while (true) {
+			while (this->q_tail != this->q_head) {
+				auto &t = this->queue[this->q_tail % queue_cap];
+				status_e s = this->run(t, nullptr, nullptr);
+				if (t.cb != nullptr)
+					t.cb(t, s);
+				this->q_tail = this->q_tail + 1;
+			}
+
+			this->io->close();
+
+			// NOTE recheck with interrupts off so no submission is stranded
+			bool done = atomic([this]() {
+				if (this->q_tail != this->q_head)
+					return false;
+				this->busy = false;
+				return true;
+			});
+			if (done)
+				break;
+
+			this->io->open();
+		}
+	}
+
+	status_e run(
+		const struct transaction &t,
+		std::size_t *slen, std::size_t *rlen
+	) {
+		std::size_t n;
+
+		this->io->connect(t.addr);
+
+		if (t.tx_len > 0 || t.rx_len == 0) {
+			n = this->io->send(t.tx, t.tx_len);
+			if (slen != nullptr) *slen = n;
+			if (this->io->status != status_e::ST_SUCCESS)
+				return this->io->status;
+		}
+
+		if (t.rx_len > 0) {
+			n = this->io->recv(t.rx, t.rx_len);
+			if (rlen != nullptr) *rlen = n;
+			if (this->io->status != status_e::ST_SUCCESS)
+				return this->io->status;
+		}
+
+		return status_e::ST_SUCCESS;
+	}
+
+public:
+	manager(i2c_socket::primary *io) : io(io) {}
+
+	// NOTE nullptr if out of handles
+	device *open(const i2c_address &addr) {
+		if (this->n_devices >= device_cap)
+			return nullptr;
+		auto *d = &this->devices[this->n_devices++];
+		*d = device(this, addr);
+		return d;
+	}
+
+	// synchronous transaction
+	// NOTE fails with `status_e::ST_LOCKED` when called from an ISR 
+	//	that interrupted a transaction, use `submit` there
+	status_e transfer(
+		const struct transaction &t,
+		std::size_t *slen, std::size_t *rlen
+	) {
+		if (!this->lock())
+			return status_e::ST_LOCKED;
+
+		status_e s = this->run(t, slen, rlen);
+		this->unlock();
+		return s;
+	}
+
+	// queue a transaction, never touches the bus
+	// runs on the next `process`, or with the batch of a transfer holding the bus
+	// NOTE an interrupt only queues, the transfer itself is left to the main loop
+	status_e submit(const struct transaction &t) {
+		bool queued = atomic([this, &t]() {
+			if (this->q_head - this->q_tail >= queue_cap)
+				return false;
+			this->queue[this->q_head % queue_cap] = t;
+			this->q_head = this->q_head + 1;
+			return true;
+		});
+		if (!queued)
+			return status_e::ST_TOOLONG;
+
+		return status_e::ST_SUCCESS;
+	}
+
+	// run the queued transactions, from the main loop
+	// NOTE nothing to do if a transfer holds the bus, it runs them on unlock
+	void process() {
+		if (this->pending() != 0 && this->lock())
+			this->unlock();
+	}
+
+	std::size_t pending() const { return this->q_head - this->q_tail; }
+};
+
+using device = manager::device;
+}
 }
 
 namespace tinyzero {
@@ -385,7 +806,13 @@ inline vendor_samd::i2c_socket::primary primary_sercom3((struct vendor_samd::i2c
 	.clkid = vendor_samd::clock::devid_e::CLKDEVID_SERCOM3,
 	.irqn = SERCOM3_IRQn,
 	.port_sda = &tinyzero::port::ports::PA22_AD4_SDA,
-	.port_scl = &tinyzero::port::ports::PA23_AD5_SCL
+	.port_scl = &tinyzero::port::ports::PA23_AD5_SCL,
+	.pwr = &tinyzero::pms::pm0,
+	.apbcid = vendor_samd::pm::apbc_e::APBC_SERCOM3
 });
 }
+
+namespace i2c_buses {
+inline vendor_samd::i2c_bus::manager bus_sercom3(&i2c_sockets::primary_sercom3);
+}
 }
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+
+
+// I2C transaction tracer
+// NOTE hardware independent: time source is injected, builds on host as well
+namespace i2c_trace {
+enum dir_e : uint8_t {
+	DIR_WRITE = 0,
+	DIR_READ = 1
+};
+
+struct record_s {
+	uint32_t t_start;	// us
+	uint32_t duration;	// us
+	uint16_t len;		// bytes transferred
+	uint8_t addr;		// 7 bit address
+	enum dir_e dir : 1;
+	bool is_nack : 1;
+	uint8_t status;		// raw `vendor_samd::i2c_status`
+} __attribute__((packed));
+
+class tracer {
+public:
+	// NOTE time in microseconds, e.g. arduino's `micros`
+	using clock_fn_t = uint32_t ();
+
+	static const constexpr std::size_t
+		ring_cap = 32,
+		n_buckets = 8;
+
+	// latency histogram: bucket i holds durations below (64 << i) us, last one is open
+	static constexpr uint32_t bucket_bound(std::size_t i) { return 64ul << i; }
+
+	struct stats_s {
+		uint32_t n_transactions = 0;
+		uint32_t n_nack = 0;
+		uint32_t n_error = 0;
+		uint32_t n_bytes = 0;
+		uint32_t duration_max = 0;
+		uint32_t buckets[n_buckets] = {};
+		uint32_t t_first = 0, t_last = 0;
+
+		// permille of transactions NACKed
+		uint32_t nack_rate() const {
+			if (this->n_transactions == 0)
+				return 0;
+			return (uint64_t)this->n_nack * 1000 / this->n_transactions;
+		}
+
+		uint32_t bytes_per_sec() const {
+			uint32_t span = this->t_last - this->t_first;
+			if (span == 0)
+				return 0;
+			return (uint64_t)this->n_bytes * 1000000 / span;
+		}
+
+		operator std::string() const {
+			std::string s = std::string("")
+				+ "n = " + std::to_string(this->n_transactions) + ", "
+				+ "nack = " + std::to_string(this->nack_rate()) + "permille, "
+				+ "err = " + std::to_string(this->n_error) + ", "
+				+ "rate = " + std::to_string(this->bytes_per_sec()) + "B/s, "
+				+ "max = " + std::to_string(this->duration_max) + "us, "
+				+ "hist =";
+			for (auto b : this->buckets)
+				s += " " + std::to_string(b);
+			return s;
+		}
+	};
+
+protected:
+	clock_fn_t *clock_f = nullptr;
+
+	// NOTE oldest records are overwritten
+	struct record_s ring[ring_cap] = {};
+	std::size_t n_records = 0;
+
+	struct stats_s stats_ = {};
+
+public:
+	tracer(clock_fn_t *clock_f) : clock_f(clock_f) {}
+
+	uint32_t begin() { return this->clock_f(); }
+
+	void end(
+		uint32_t t_start,
+		uint8_t addr, enum dir_e dir, std::size_t len,
+		uint8_t status, bool is_nack
+	) {
+		uint32_t t_end = this->clock_f();
+		uint32_t duration = t_end - t_start;
+
+		this->ring[this->n_records % ring_cap] = (struct record_s) {
+			.t_start = t_start,
+			.duration = duration,
+			.len = (uint16_t)len,
+			.addr = addr,
+			.dir = dir,
+			.is_nack = is_nack,
+			.status = status
+		};
+		this->n_records += 1;
+
+		auto &st = this->stats_;
+		if (st.n_transactions == 0)
+			st.t_first = t_start;
+		st.t_last = t_end;
+
+		st.n_transactions += 1;
+		st.n_bytes += len;
+		if (is_nack) st.n_nack += 1;
+		else if (status != 0) st.n_error += 1;
+
+		st.duration_max = std::max(st.duration_max, duration);
+
+		std::size_t i = 0;
+		while (i < n_buckets - 1 && duration >= bucket_bound(i))
+			i++;
+		st.buckets[i] += 1;
+	}
+
+	// NOTE not synchronized with tracing from ISRs, figures may be torn
+	const struct stats_s &stats() const { return this->stats_; }
+
+	// i-th most recent record, 0 being the latest
+	const struct record_s *record(std::size_t i) const {
+		if (i >= std::min(this->n_records, ring_cap))
+			return nullptr;
+		return &this->ring[(this->n_records - 1 - i) % ring_cap];
+	}
+
+	void clear() {
+		this->n_records = 0;
+		this->stats_ = {};
+	}
+};
+}
@@ -5,6 +5,7 @@
 #include "arduino.h"
 
 #include "utils.h"
+#include "port.h"
 
 
 // TODO
@@ -14,41 +15,43 @@ namespace displays {
 class ledcircle {
 protected:
 	class pin {
-		uint32_t _base;
+		vendor_samd::pin _base;
 
 	public:
-		template <typename T>
-		pin(T n) : _base(n) {}
+		constexpr pin(const vendor_samd::pin &p) : _base(p) {}
 
 		void
 		set_high()
 		{
-			digitalWrite(this->_base, HIGH);
-			pinMode(this->_base, OUTPUT);
+			this->_base.set_high().set_output();
 		}
 
 		void
 		set_low()
 		{
-			digitalWrite(this->_base, LOW);
-			pinMode(this->_base, OUTPUT);
+			this->_base.set_low().set_output();
 		}
 
 		void
 		set_high_z()
 		{
-			pinMode(this->_base, INPUT);
-			digitalWrite(this->_base, LOW);
+			this->_base.set_input().set_low();
 		}
 	};
 
+	static constexpr const vendor_samd::pin
+		&P5 = port::pins::D5_PA15,
+		&P6 = port::pins::D6_PA20,
+		&P7 = port::pins::D7_PA21,
+		&P8 = port::pins::D8_PA06,
+		&P9 = port::pins::D9_PA07;
+
 public:
 	class led {
 		pin pin_hi, pin_lo;
 
 	public:
-		template <typename T>
-		led(T pin_hi, T pin_lo)
+		constexpr led(const vendor_samd::pin &pin_hi, const vendor_samd::pin &pin_lo)
 			: pin_hi(pin_hi), pin_lo(pin_lo) {}
 
 		void
@@ -73,24 +76,24 @@ public:
 		}
 	};
 
-	pin pins[5] = {5, 6, 7, 8, 9};
+	pin pins[5] = {P5, P6, P7, P8, P9};
 	led leds[16] = {
-		led(5, 6),
-		led(6, 5),
-		led(5, 7),
-		led(7, 5),
-		led(6, 7),
-		led(7, 6),
-		led(6, 8),
-		led(8, 6),
-		led(5, 8),
-		led(8, 5),
-		led(8, 7),
-		led(7, 8),
-		led(9, 7),
-		led(7, 9),
-		led(9, 8),
-		led(8, 9)
+		led(P5, P6),
+		led(P6, P5),
+		led(P5, P7),
+		led(P7, P5),
+		led(P6, P7),
+		led(P7, P6),
+		led(P6, P8),
+		led(P8, P6),
+		led(P5, P8),
+		led(P8, P5),
+		led(P8, P7),
+		led(P7, P8),
+		led(P9, P7),
+		led(P7, P9),
+		led(P9, P8),
+		led(P8, P9)
 	};
 
 	ledcircle() {}
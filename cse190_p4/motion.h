@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+
+
+// fixed-point motion classifier
+// features over a window of samples: per-axis variance, magnitude of the mean,
+//	zero crossings on the most active axis
+// NOTE hardware independent, no floating point, O(window) per window
+// NOTE per axis, not over the magnitude: motion along the surface of a sphere
+//	(e.g. tilting, a lateral shake on top of gravity) keeps the magnitude constant
+namespace motion {
+enum class_e : uint8_t {
+	CLASS_STILL = 0,
+	// walking, handling: strong low frequency motion
+	CLASS_CARRIED = 1,
+	// weak low frequency motion: vehicles, slow bags
+	CLASS_VEHICLE = 2,
+	// high frequency motion of any strength: machinery, vibrating surfaces
+	// NOTE not moving, the tag stays where it is
+	CLASS_VIBRATION = 3
+};
+
+inline const char *to_string(enum class_e c) {
+	switch (c) {
+	case class_e::CLASS_STILL: return "still";
+	case class_e::CLASS_CARRIED: return "carried";
+	case class_e::CLASS_VEHICLE: return "vehicle";
+	case class_e::CLASS_VIBRATION: return "vibration";
+	}
+	return "?";
+}
+
+// NOTE in sensor LSB (e.g. 256 LSB/g for the BMA250 at 2g)
+struct features_s {
+	// magnitude of the mean, ~1g at rest
+	uint16_t mean;
+	// LSB^2, sum over the axes
+	uint32_t variance;
+	uint32_t axis_variance[3];
+	// most active axis, the crossings are counted on
+	uint8_t axis;
+	uint16_t n_crossings;
+
+	operator std::string() const {
+		return std::string("")
+			+ "mean = " + std::to_string(this->mean) + ", "
+			+ "var = " + std::to_string(this->variance) + " ("
+				+ std::to_string(this->axis_variance[0]) + ", "
+				+ std::to_string(this->axis_variance[1]) + ", "
+				+ std::to_string(this->axis_variance[2]) + "), "
+			+ "zc = " + std::to_string(this->n_crossings)
+				+ " (" + "xyz"[this->axis] + ")";
+	}
+};
+
+// 32 bit integer square root, 16 iterations
+constexpr uint16_t isqrt(uint32_t x) {
+	uint32_t res = 0;
+	for (uint32_t bit = 1ul << 30; bit != 0; bit >>= 2) {
+		if (x >= res + bit) {
+			x -= res + bit;
+			res = (res >> 1) + bit;
+		} else res >>= 1;
+	}
+	return res;
+}
+
+template <std::size_t window>
+class classifier {
+	static_assert(window > 0 && (window & (window - 1)) == 0, "window not a power of 2");
+	// NOTE keeps the variance sums in 32 bits for 10 bit samples
+	static_assert(window <= 1024, "window too large");
+
+public:
+	struct policy_s {
+		// below: still (sensor noise)
+		uint32_t still_var_max = 16;
+		// crossings per window, above: vibration (~3 Hz at 15.6 Hz)
+		uint16_t vibration_crossings_min = window * 3 / 8;
+		// above: carried, below: vehicle
+		uint32_t carried_var_min = 1024;
+		// band around the mean ignored by the crossing count
+		uint16_t crossing_hyst = 4;
+
+		// moving score: added per window of each class, saturating
+		uint8_t score_carried = 4;
+		uint8_t score_vehicle = 1;
+		uint8_t score_still_decay = 1;
+		uint8_t score_vibration_decay = 1;
+		uint8_t score_max = 16;
+		uint8_t score_moving = 4;
+	};
+
+	struct stats_s {
+		uint32_t n_windows[4] = {};
+
+		operator std::string() const {
+			return std::string("")
+				+ to_string(class_e::CLASS_STILL) + " = "
+					+ std::to_string(this->n_windows[class_e::CLASS_STILL]) + ", "
+				+ to_string(class_e::CLASS_CARRIED) + " = "
+					+ std::to_string(this->n_windows[class_e::CLASS_CARRIED]) + ", "
+				+ to_string(class_e::CLASS_VEHICLE) + " = "
+					+ std::to_string(this->n_windows[class_e::CLASS_VEHICLE]) + ", "
+				+ to_string(class_e::CLASS_VIBRATION) + " = "
+					+ std::to_string(this->n_windows[class_e::CLASS_VIBRATION]);
+		}
+	};
+
+protected:
+	int16_t samples[3][window];
+	std::size_t n = 0;
+
+	struct features_s last_features = {};
+	enum class_e last_class = class_e::CLASS_STILL;
+
+	uint8_t score = 0;
+
+	struct stats_s stats_ = {};
+
+	static constexpr unsigned log2(std::size_t v) {
+		unsigned res = 0;
+		while (v >>= 1) res++;
+		return res;
+	}
+
+	struct features_s extract() const {
+		struct features_s f = {};
+
+		int32_t means[3];
+		uint32_t mean_sq = 0;
+		for (std::size_t a = 0; a < 3; a++) {
+			int32_t sum = 0;
+			for (auto v : this->samples[a])
+				sum += v;
+			means[a] = sum / (int32_t)window;
+			mean_sq += (uint32_t)(means[a] * means[a]);
+
+			uint32_t var = 0;
+			for (auto v : this->samples[a]) {
+				int32_t d = v - means[a];
+				var += (uint32_t)(d * d);
+			}
+			f.axis_variance[a] = var >> log2(window);
+			f.variance += f.axis_variance[a];
+			if (f.axis_variance[a] > f.axis_variance[f.axis])
+				f.axis = a;
+		}
+		f.mean = isqrt(mean_sq);
+
+		int8_t side = 0;
+		const int32_t hyst = this->policy.crossing_hyst;
+		for (auto v : this->samples[f.axis]) {
+			int32_t d = v - means[f.axis];
+
+			// sign changes outside the hysteresis band
+			int8_t s = d > hyst ? 1 : (d < -hyst ? -1 : 0);
+			if (s != 0) {
+				if (side != 0 && s != side)
+					f.n_crossings++;
+				side = s;
+			}
+		}
+
+		return f;
+	}
+
+	enum class_e classify(const struct features_s &f) const {
+		if (f.variance < this->policy.still_var_max)
+			return class_e::CLASS_STILL;
+		if (f.n_crossings > this->policy.vibration_crossings_min)
+			return class_e::CLASS_VIBRATION;
+		if (f.variance >= this->policy.carried_var_min)
+			return class_e::CLASS_CARRIED;
+		return class_e::CLASS_VEHICLE;
+	}
+
+	void update_score(enum class_e c) {
+		const auto &p = this->policy;
+		switch (c) {
+		case class_e::CLASS_CARRIED:
+			this->score = std::min<unsigned>(this->score + p.score_carried, p.score_max);
+			break;
+		case class_e::CLASS_VEHICLE:
+			this->score = std::min<unsigned>(this->score + p.score_vehicle, p.score_max);
+			break;
+		case class_e::CLASS_STILL:
+			this->score = this->score > p.score_still_decay
+				? this->score - p.score_still_decay
+				: 0;
+			break;
+		case class_e::CLASS_VIBRATION:
+			this->score = this->score > p.score_vibration_decay
+				? this->score - p.score_vibration_decay
+				: 0;
+			break;
+		}
+	}
+
+public:
+	struct policy_s policy;
+
+	classifier() {}
+
+	static constexpr std::size_t size() { return window; }
+
+	// true if a window was completed and classified
+	bool push(int16_t x, int16_t y, int16_t z) {
+		this->samples[0][this->n] = x;
+		this->samples[1][this->n] = y;
+		this->samples[2][this->n] = z;
+		if (++this->n < window)
+			return false;
+		this->n = 0;
+
+		this->last_features = this->extract();
+		this->last_class = this->classify(this->last_features);
+		this->stats_.n_windows[this->last_class] += 1;
+		this->update_score(this->last_class);
+		return true;
+	}
+
+	const struct features_s &features() const { return this->last_features; }
+	enum class_e get_class() const { return this->last_class; }
+
+	// carried right away, sustained vehicle motion after a few windows,
+	//	vibration and sporadic motion decay
+	bool is_moving() const { return this->score >= this->policy.score_moving; }
+
+	const struct stats_s &stats() const { return this->stats_; }
+
+	// start over, e.g. after a gap in the samples
+	void reset() {
+		this->n = 0;
+		this->score = 0;
+	}
+
+	void clear() {
+		this->reset();
+		this->stats_ = {};
+	}
+};
+}
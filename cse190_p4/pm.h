@@ -3,60 +3,385 @@
 #include <samd.h>
 
 #include "arduino.h"
+#include "wake_trace.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <algorithm>
 
 // SAMD21 power manager abstraction
 namespace vendor_samd {
-class pm {};
+struct pm_info {
+	Pm *pm;
+};
+
+// reference-counted APB clock gating
+// 16.6.2.6 Peripheral Clock Masking
+class pm {
+protected:
+	struct pm_info info;
+
+	// NOTE one counter per APBCMASK bit
+	uint8_t refs_apbc[32] = {};
+
+	template <typename fn_type>
+	static void atomic(fn_type fn) {
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		fn();
+		__set_PRIMASK(primask);
+	}
+
+public:
+	enum apbc_e : uint8_t {
+		APBC_PAC2    = PM_APBCMASK_PAC2_Pos,
+		APBC_EVSYS   = PM_APBCMASK_EVSYS_Pos,
+		APBC_SERCOM0 = PM_APBCMASK_SERCOM0_Pos,
+		APBC_SERCOM1 = PM_APBCMASK_SERCOM1_Pos,
+		APBC_SERCOM2 = PM_APBCMASK_SERCOM2_Pos,
+		APBC_SERCOM3 = PM_APBCMASK_SERCOM3_Pos,
+		APBC_SERCOM4 = PM_APBCMASK_SERCOM4_Pos,
+		APBC_SERCOM5 = PM_APBCMASK_SERCOM5_Pos,
+		APBC_TCC0    = PM_APBCMASK_TCC0_Pos,
+		APBC_TCC1    = PM_APBCMASK_TCC1_Pos,
+		APBC_TCC2    = PM_APBCMASK_TCC2_Pos,
+		APBC_TC3     = PM_APBCMASK_TC3_Pos,
+		APBC_TC4     = PM_APBCMASK_TC4_Pos,
+		APBC_TC5     = PM_APBCMASK_TC5_Pos,
+		APBC_ADC     = PM_APBCMASK_ADC_Pos,
+		APBC_AC      = PM_APBCMASK_AC_Pos,
+		APBC_DAC     = PM_APBCMASK_DAC_Pos
+		// TODO implement rest
+	};
+
+	pm(const struct pm_info &info) : info(info) {}
+
+	// clock the peripheral, first user ungates it
+	pm &acquire(enum apbc_e id) {
+		atomic([this, id]() {
+			if (this->refs_apbc[id]++ == 0)
+				this->info.pm->APBCMASK.reg |= 1ul << id;
+		});
+		return *this;
+	}
+
+	// last user gates it
+	pm &release(enum apbc_e id) {
+		atomic([this, id]() {
+			if (this->refs_apbc[id] == 0)
+				return;
+			if (--this->refs_apbc[id] == 0)
+				this->info.pm->APBCMASK.reg &= ~(1ul << id);
+		});
+		return *this;
+	}
+
+	// gate whatever nobody holds (e.g. everything arduino's `init` turned on)
+	pm &gate_unused() {
+		atomic([this]() {
+			uint32_t mask = 0;
+			for (std::size_t i = 0; i < 32; i++)
+				if (this->refs_apbc[i] > 0)
+					mask |= 1ul << i;
+			this->info.pm->APBCMASK.reg = mask;
+		});
+		return *this;
+	}
+
+	std::size_t get_refs(enum apbc_e id) const {
+		return this->refs_apbc[id];
+	}
+};
 
 // enter standby mode
 // implementation based on @arduino's ArduinoLowPower library
 // ref https://github.com/arduino-libraries/ArduinoLowPower/blob/7fc3c446dad729d2c8d94d7617d6ce725e122c3b/src/samd/ArduinoLowPower.cpp#L38
 // FOR DETAILS ON FREEDOM OF USE PLEASE REFER TO THE LICENSE INCLUDED IN THE SOURCE REPO
 // https://github.com/arduino-libraries/ArduinoLowPower/blob/master/LICENSE 
-inline void standby() {
-	class _ctx_usb_c {
-	protected:
-		bool connected = false;
+// NOTE the USB and SysTick bookkeeping is cached across cycles,
+//	only changes of state touch the peripherals
+class standby_path {
+public:
+	enum usb_policy_e {
+		// suspend if opened by a host, detach otherwise and reattach on wake-up
+		USB_FOLLOW,
+		// detach once and keep the USB peripheral down (production)
+		USB_DETACHED
+	};
+
+	// entry/exit overhead in CPU cycles, measured on SysTick
+	// NOTE SysTick is stopped in standby, so the time asleep is not included
+	struct cost_s {
+		uint32_t n = 0;
+		uint32_t entry_last = 0, entry_max = 0;
+		uint32_t exit_last = 0, exit_max = 0;
+
+		operator std::string() const {
+			return std::string("")
+				+ "n = " + std::to_string(this->n) + ", "
+				+ "entry = " + std::to_string(this->entry_last) 
+					+ " (max " + std::to_string(this->entry_max) + ") cycles, "
+				+ "exit = " + std::to_string(this->exit_last) 
+					+ " (max " + std::to_string(this->exit_max) + ") cycles";
+		}
+	};
+
+	// wake-up source: pending interrupt, narrowed down to EIC lines for `EIC_IRQn`
+	// NOTE `SysTick_IRQn` is the only system exception recognized (idle modes)
+	struct wake_source_s {
+		IRQn_Type irqn;
+		// NOTE 0 matches any line
+		uint32_t eic_mask;
+	};
+
+protected:
+	enum usb_policy_e usb_policy = usb_policy_e::USB_FOLLOW;
 
-	public:
-		void standby() {
+	// USB is known to be detached, no need to check the host again
+	bool usb_detached = false;
+	// USB was suspended (opened by host) on entry
+	bool usb_suspended = false;
+
+	struct cost_s cost_ = {};
+
+	wake_trace::tracer *tracer = nullptr;
+	const struct wake_source_s *wake_sources = nullptr;
+	std::size_t n_wake_sources = 0;
+
+	// bit i set if `wake_sources[i]` is pending
+	// NOTE requires PRIMASK set across WFI, otherwise the handlers have already run
+	uint32_t pending_sources() const {
+		uint32_t ispr = NVIC->ISPR[0];
+		uint32_t eic = EIC->INTFLAG.reg;
+		bool systick = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+
+		uint32_t res = 0;
+		for (std::size_t i = 0; i < this->n_wake_sources; i++) {
+			const auto &src = this->wake_sources[i];
+			if (src.irqn == SysTick_IRQn) {
+				if (systick)
+					res |= 1ul << i;
+				continue;
+			}
+			if (src.irqn < 0 || !(ispr & (1ul << src.irqn)))
+				continue;
+			if (src.irqn == EIC_IRQn && src.eic_mask != 0 && !(eic & src.eic_mask))
+				continue;
+			res |= 1ul << i;
+		}
+		return res;
+	}
+
+	// cycles elapsed since `t0` on the down-counting SysTick
+	// NOTE valid for spans shorter than one SysTick period (1 ms)
+	static uint32_t cycles_since(uint32_t t0) {
+		uint32_t t1 = SysTick->VAL;
+		uint32_t period = (SysTick->LOAD & SysTick_LOAD_RELOAD_Msk) + 1;
+		return (t0 + period - t1) % period;
+	}
+
+	void usb_standby() {
+		if (this->usb_detached)
+			return;
+
+		switch (this->usb_policy) {
+		case usb_policy_e::USB_DETACHED:
+			USBDevice.detach();
+			this->usb_detached = true;
+			break;
+		case usb_policy_e::USB_FOLLOW:
 			// check if USB "configured and opened by host"
 			// see Serial_::operator bool() and USBDeviceClass::connected()
 			// ref packages/TinyCircuits/hardware/samd/1.1.0/cores/arduino/USB/CDC.cpp
 			// ref packages/TinyCircuits/hardware/samd/1.1.0/cores/arduino/USB/USBCore.cpp
-			this->connected = USBDevice.connected();
-			if (this->connected) USBDevice.standby();
+			this->usb_suspended = USBDevice.connected();
+			if (this->usb_suspended) USBDevice.standby();
 			else USBDevice.detach();
+			break;
 		}
+	}
 
-		void wakeup() {
-			if (this->connected) /* noop */;
-			else USBDevice.attach();
-		}
-	} _ctx_usb;
-
-	class _ctx_systick_c {
-	public:
-		void standby() {
-			// disable systick interrupt: (workaround for hardware bug in SAMD21)
-			// see https://www.avrfreaks.net/forum/samd21-samd21e16b-sporadically-locks-and-does-not-wake-standby-sleep-mode
-			SysTick->CTRL &= ~SysTick_CTRL_TICKINT_Msk;	
-		}
+	void usb_wakeup() {
+		if (this->usb_policy == usb_policy_e::USB_DETACHED)
+			return;
+		if (!this->usb_suspended) USBDevice.attach();
+	}
 
-		void wakeup() {
-			// reenable systick interrupt
-			SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk;	
-		}
-	} _ctx_systick;
+public:
+	standby_path() {}
+
+	standby_path &set_usb_policy(enum usb_policy_e policy) {
+		this->usb_policy = policy;
+		// NOTE reattach lazily on the next wake-up
+		if (policy == usb_policy_e::USB_FOLLOW)
+			this->usb_detached = false;
+		return *this;
+	}
+
+	const struct cost_s &cost() const { return this->cost_; }
+
+	// NOTE source i of `sources` is reported as source i of `tracer`
+	standby_path &set_wake_trace(
+		wake_trace::tracer *tracer,
+		const struct wake_source_s *sources, std::size_t n_sources
+	) {
+		this->tracer = tracer;
+		this->wake_sources = sources;
+		this->n_wake_sources = n_sources;
+		return *this;
+	}
+
+	// bracket a sleep entered elsewhere (e.g. an idle mode) for the wake-up trace
+	// NOTE with PRIMASK set, see `pending_sources`
+	void trace_begin() {
+		if (this->tracer != nullptr)
+			this->tracer->sleep_begin();
+	}
 
-	_ctx_usb.standby();
-	_ctx_systick.standby();
+	void trace_end() {
+		if (this->tracer != nullptr)
+			this->tracer->sleep_end(this->pending_sources());
+	}
 
-	SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk; // deep sleep
-	__DSB(); // wait for data sync completion
-	__WFI(); // wait for interrupt
+	void enter() {
+		this->trace_begin();
+
+		uint32_t t_entry = SysTick->VAL;
+
+		this->usb_standby();
+
+		// disable systick interrupt: (workaround for hardware bug in SAMD21)
+		// see https://www.avrfreaks.net/forum/samd21-samd21e16b-sporadically-locks-and-does-not-wake-standby-sleep-mode
+		// NOTE the read-modify-write is skipped when already disabled
+		bool tickint = SysTick->CTRL & SysTick_CTRL_TICKINT_Msk;
+		if (tickint)
+			SysTick->CTRL &= ~SysTick_CTRL_TICKINT_Msk;
+
+		this->cost_.entry_last = cycles_since(t_entry);
+
+		SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk; // deep sleep
+		__DSB(); // wait for data sync completion
+		__WFI(); // wait for interrupt
+
+		uint32_t t_exit = SysTick->VAL;
+
+		// reenable systick interrupt
+		if (tickint)
+			SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk;
+
+		this->usb_wakeup();
+
+		auto &c = this->cost_;
+		c.exit_last = cycles_since(t_exit);
+		c.n += 1;
+		c.entry_max = std::max(c.entry_max, c.entry_last);
+		c.exit_max = std::max(c.exit_max, c.exit_last);
+
+		this->trace_end();
+	}
+};
+
+// uncached standby, see `standby_path`
+inline void standby() {
+	standby_path().enter();
+}
+
+// 16.6.2.8 Sleep Mode Operation
+// ordered by savings, deeper modes take longer to wake up from
+enum sleepmode_e {
+	SLEEP_NONE = -1,
+	SLEEP_IDLE0 = PM_SLEEP_IDLE_CPU_Val,	// CPU stopped
+	SLEEP_IDLE1 = PM_SLEEP_IDLE_AHB_Val,	// CPU, AHB stopped
+	SLEEP_IDLE2 = PM_SLEEP_IDLE_APB_Val,	// CPU, AHB, APB stopped
+	SLEEP_STANDBY							// all clocks stopped but RUNSTDBY ones
+};
+
+// enter an idle mode
+inline void idle(enum sleepmode_e mode) {
+	SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+	PM->SLEEP.reg = PM_SLEEP_IDLE(mode);
+	__DSB();
+	__WFI();
+}
+
+// sleep-mode governor
+// picks the cheapest mode whose wake-up latency fits the expected idle time
+class governor {
+public:
+	struct policy_s {
+		// minimum expected idle time for standby (DFLL relock etc.)
+		std::size_t standby_min_us = 10000;
+	};
+
+	// NOTE microseconds until the next known deadline (e.g. `timer::get_time_to_match_us`)
+	using deadline_fn_t = std::size_t ();
+	// NOTE true if there is work left for the main loop
+	using pending_fn_t = bool ();
+
+protected:
+	bool standby_allowed = true;
+
+public:
+	struct policy_s policy;
+
+	deadline_fn_t *deadline_f = nullptr;
+	pending_fn_t *pending_f = nullptr;
+	// NOTE falls back to the uncached `standby()` if unset;
+	//	its wake-up trace covers the idle modes as well
+	standby_path *standby_p = nullptr;
+
+	governor() {}
+
+	// NOTE wake sources that only run with clocks on (e.g. edge-sensing EIC) 
+	//	require standby to be disallowed
+	governor &allow_standby(bool allowed) {
+		this->standby_allowed = allowed;
+		return *this;
+	}
+
+	// NOTE no transfer is in flight here: I2C and SPI transfers complete before
+	//	the main loop sleeps, queued ones are `pending_f` work; a wait on
+	//	DMA idles in IDLE0 on its own (see `SPI_DMA_Transfer`)
+	enum sleepmode_e select() const {
+		if (!this->standby_allowed)
+			return sleepmode_e::SLEEP_IDLE2;
+
+		if (this->deadline_f != nullptr
+			&& this->deadline_f() < this->policy.standby_min_us)
+			return sleepmode_e::SLEEP_IDLE2;
+
+		return sleepmode_e::SLEEP_STANDBY;
+	}
+
+	// sleep until the next interrupt unless work is pending
+	// NOTE interrupts are masked while deciding so a wake-up cannot be missed:
+	//	a pending interrupt still ends WFI and is serviced after PRIMASK is restored
+	enum sleepmode_e sleep() {
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+
+		enum sleepmode_e mode = sleepmode_e::SLEEP_NONE;
+		if (this->pending_f == nullptr || !this->pending_f()) {
+			mode = this->select();
+			if (mode != sleepmode_e::SLEEP_STANDBY) {
+				if (this->standby_p != nullptr) this->standby_p->trace_begin();
+				idle(mode);
+				if (this->standby_p != nullptr) this->standby_p->trace_end();
+			}
+			else if (this->standby_p != nullptr) this->standby_p->enter();
+			else standby();
+		}
+
+		__set_PRIMASK(primask);
+		return mode;
+	}
+};
+}
 
-	_ctx_systick.wakeup();
-	_ctx_usb.wakeup();
+namespace tinyzero {
+namespace pms {
+inline vendor_samd::pm pm0({PM});
+inline vendor_samd::standby_path standby0;
 }
 }
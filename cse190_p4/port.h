@@ -29,6 +29,10 @@ class port {
 protected:
 	struct port_info info;
 
+	PortGroup &group() { return this->info.port->Group[this->info.group]; }
+
+	constexpr uint32_t mask() const { return 1ul << this->info.n; }
+
 public:
 	port(const struct port_info &info) : info(info) {}
 
@@ -45,6 +49,185 @@ public:
 
 		return *this;
 	}
+
+	// hand the pin back to the PORT (GPIO) controller
+	port &unset_mux() {
+		this->group().PINCFG[this->info.n].bit.PMUXEN = false;
+		return *this;
+	}
+
+	// 23.6.3.1 Basic Operation
+	port &set_output() {
+		this->group().DIRSET.reg = this->mask();
+		return *this;
+	}
+
+	port &set_input() {
+		this->group().DIRCLR.reg = this->mask();
+		this->group().PINCFG[this->info.n].bit.INEN = true;
+		return *this;
+	}
+
+	port &set_high() {
+		this->group().OUTSET.reg = this->mask();
+		return *this;
+	}
+
+	port &set_low() {
+		this->group().OUTCLR.reg = this->mask();
+		return *this;
+	}
+
+	bool read() {
+		return (this->group().IN.reg & this->mask()) != 0;
+	}
+};
+
+// compile-time pin descriptor
+// NOTE accessed through the single-cycle IOBUS port (23.5.8 IOBUS), 
+//	no arduino pin table lookup or read-modify-write
+class pin {
+protected:
+	enum port_group_e grp;
+	uint32_t n;
+
+	PortGroup &group() const { return PORT_IOBUS->Group[this->grp]; }
+
+public:
+	constexpr pin(enum port_group_e grp, uint32_t n) : grp(grp), n(n) {}
+
+	constexpr uint32_t mask() const { return 1ul << this->n; }
+
+	const pin &set_output() const {
+		this->group().DIRSET.reg = this->mask();
+		return *this;
+	}
+
+	const pin &set_input() const {
+		this->group().DIRCLR.reg = this->mask();
+		return *this;
+	}
+
+	const pin &set_high() const {
+		this->group().OUTSET.reg = this->mask();
+		return *this;
+	}
+
+	const pin &set_low() const {
+		this->group().OUTCLR.reg = this->mask();
+		return *this;
+	}
+
+	const pin &write(bool high) const {
+		return high ? this->set_high() : this->set_low();
+	}
+
+	const pin &toggle() const {
+		this->group().OUTTGL.reg = this->mask();
+		return *this;
+	}
+
+	// NOTE requires PINCFG.INEN, e.g. set by `pinMode(..., INPUT)`
+	bool read() const {
+		return (this->group().IN.reg & this->mask()) != 0;
+	}
+
+	const pin &set_mux(enum port_type_e mode) const {
+		auto &pmux = this->group().PMUX[this->n / 2].bit;
+
+		// port number even?
+		if (this->n % 2 == 0) pmux.PMUXE = mode;
+		else pmux.PMUXO = mode;
+
+		this->group().PINCFG[this->n].bit.PMUXEN = true;
+		this->group().PINCFG[this->n].bit.INEN = true;
+		return *this;
+	}
+};
+
+// external interrupt line
+// 20. EIC – External Interrupt Controller
+class extint {
+protected:
+	uint8_t line;
+
+	// NOTE CONFIG and EVCTRL are enable-protected
+	template <typename fn_type>
+	static void configure(fn_type fn) {
+		bool enabled = EIC->CTRL.bit.ENABLE;
+
+		EIC->CTRL.bit.ENABLE = false;
+		while (EIC->STATUS.bit.SYNCBUSY);
+
+		fn();
+
+		EIC->CTRL.bit.ENABLE = enabled;
+		while (EIC->STATUS.bit.SYNCBUSY);
+	}
+
+public:
+	// 20.8.10 Configuration n: SENSEx
+	enum sense_e : uint32_t {
+		SENSE_NONE = EIC_CONFIG_SENSE0_NONE_Val,
+		SENSE_RISE = EIC_CONFIG_SENSE0_RISE_Val,
+		SENSE_FALL = EIC_CONFIG_SENSE0_FALL_Val,
+		SENSE_BOTH = EIC_CONFIG_SENSE0_BOTH_Val,
+		SENSE_HIGH = EIC_CONFIG_SENSE0_HIGH_Val,
+		SENSE_LOW  = EIC_CONFIG_SENSE0_LOW_Val
+	};
+
+	constexpr extint(uint8_t line) : line(line) {}
+
+	constexpr uint32_t mask() const { return 1ul << this->line; }
+
+	// event generator ID, see `evsys::channel::route`
+	constexpr uint8_t evgen() const {
+		return EVSYS_ID_GEN_EIC_EXTINT_0 + this->line;
+	}
+
+	// NOTE edge detection needs GCLK_EIC running, 
+	//	level detection (without filter) also works asynchronously in standby
+	const extint &set_sense(enum sense_e sense, bool filter = false) const {
+		configure([this, sense, filter]() {
+			auto &config = EIC->CONFIG[this->line / 8].reg;
+			const uint32_t shift = 4 * (this->line % 8);
+
+			config &= ~(0xFul << shift);
+			config |= ((uint32_t)sense | (filter ? EIC_CONFIG_FILTEN0 : 0))
+				<< shift;
+		});
+		return *this;
+	}
+
+	// EXTINTEOx: emit an event on detection instead of (or alongside) the interrupt
+	const extint &set_event_output(bool enable = true) const {
+		configure([this, enable]() {
+			if (enable) EIC->EVCTRL.reg |= this->mask();
+			else EIC->EVCTRL.reg &= ~this->mask();
+		});
+		return *this;
+	}
+
+	const extint &set_wakeup(bool enable = true) const {
+		if (enable) EIC->WAKEUP.reg |= this->mask();
+		else EIC->WAKEUP.reg &= ~this->mask();
+		return *this;
+	}
+
+	const extint &set_interrupt(bool enable = true) const {
+		if (enable) EIC->INTENSET.reg = this->mask();
+		else EIC->INTENCLR.reg = this->mask();
+		return *this;
+	}
+
+	bool is_pending() const {
+		return (EIC->INTFLAG.reg & this->mask()) != 0;
+	}
+
+	const extint &clear() const {
+		EIC->INTFLAG.reg = this->mask();
+		return *this;
+	}
 };
 }
 
@@ -54,4 +237,25 @@ inline vendor_samd::port
 	PA22_AD4_SDA({PORT, vendor_samd::port_group_e::PGRP_A, 22}),
     PA23_AD5_SCL({PORT, vendor_samd::port_group_e::PGRP_A, 23});
 }
+
+// arduino pin number to port pin
+// NOTE ref packages/TinyCircuits/hardware/samd/1.1.0/variants/tinyzero/variant.cpp
+namespace pins {
+inline constexpr vendor_samd::pin
+	D2_PA14(vendor_samd::port_group_e::PGRP_A, 14),
+	D5_PA15(vendor_samd::port_group_e::PGRP_A, 15),
+	D6_PA20(vendor_samd::port_group_e::PGRP_A, 20),
+	D7_PA21(vendor_samd::port_group_e::PGRP_A, 21),
+	D8_PA06(vendor_samd::port_group_e::PGRP_A, 6),
+	D9_PA07(vendor_samd::port_group_e::PGRP_A, 7),
+	D10_PA18(vendor_samd::port_group_e::PGRP_A, 18),
+	D13_PA17(vendor_samd::port_group_e::PGRP_A, 17);
+}
+
+// external interrupt lines of the pins above
+namespace extints {
+inline constexpr vendor_samd::extint
+	D2_PA14_EXTINT14(14),
+	D13_PA17_EXTINT1(1);
+}
 }
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <samd.h>
+
+#include "clock.h"
+
+
+// SAMD21 RTC abstraction: free-running 32 bit counter
+// 19. RTC – Real-Time Counter, mode 0
+// NOTE keeps counting in standby as long as its generic clock does
+namespace vendor_samd {
+struct rtc_info {
+	Rtc *rtc;
+	enum clock::devid_e clkid;	// clock ID
+};
+
+class rtc {
+protected:
+	struct rtc_info info;
+
+	clock *clk = nullptr;
+
+	RtcMode0 *mode0() const { return &this->info.rtc->MODE0; }
+
+public:
+	rtc(const struct rtc_info &info) : info(info) {}
+
+	// NOTE the RTC APB (APBA) clock is on after reset
+	rtc &init(clock *clk) {
+		this->clk = clk;
+		this->clk->attach(this->info.clkid);
+
+		auto *r = this->mode0();
+		r->CTRL.bit.SWRST = true;
+		while (r->CTRL.bit.SWRST || r->STATUS.bit.SYNCBUSY);
+
+		// NOTE CTRL is enable-protected
+		r->CTRL.reg = RTC_MODE0_CTRL_MODE_COUNT32
+			| RTC_MODE0_CTRL_PRESCALER_DIV1;
+
+		// 19.6.8 Synchronization: continuous read requests,
+		//	COUNT is read without waiting for a synchronization
+		r->READREQ.reg = RTC_READREQ_RREQ | RTC_READREQ_RCONT
+			| RTC_READREQ_ADDR(RTC_MODE0_COUNT_OFFSET);
+		this->wait_sync();
+		return *this;
+	}
+
+	rtc &enable() {
+		this->mode0()->CTRL.bit.ENABLE = true;
+		this->wait_sync();
+		return *this;
+	}
+
+	rtc &disable() {
+		this->mode0()->CTRL.bit.ENABLE = false;
+		this->wait_sync();
+		return *this;
+	}
+
+	rtc &wait_sync() {
+		while (this->mode0()->STATUS.bit.SYNCBUSY);
+		return *this;
+	}
+
+	// NOTE lags the counter by the synchronization delay (a few ticks)
+	uint32_t get_count() const {
+		return this->mode0()->COUNT.reg;
+	}
+
+	// NOTE frequency in Hz
+	std::size_t get_tick_freq() {
+		return this->clk->get_freq();
+	}
+};
+}
+
+
+namespace tinyzero {
+namespace rtcs {
+inline vendor_samd::rtc rtc0({
+	RTC,
+	vendor_samd::clock::devid_e::CLKDEVID_RTC
+});
+}
+}
@@ -472,6 +472,13 @@ typedef __packed struct _gatt_add_char_desc_rp{
 #define GATT_ADD_CHAR_DESC_RP_SIZE 3
 
 #define OCF_GATT_UPD_CHAR_VAL		0x0106
+#define GATT_UPD_CHAR_VAL_CP_SIZE 6  // without value
+typedef __packed struct _gatt_upd_char_val_cp{
+  uint16_t service_handle;
+  uint16_t char_handle;
+  uint8_t  val_offset;
+  uint8_t  val_len;
+} PACKED gatt_upd_char_val_cp;
 
 #define OCF_GATT_DEL_CHAR   		0x0107
 typedef __packed struct _gatt_del_char_cp{
@@ -88,6 +88,53 @@
  */
 //void Hal_Write_Serial(const void* data1, const void* data2, uint16_t n_bytes1, uint16_t n_bytes2);
 
+/**
+ * Maximum number of segments of a scatter-gather write.
+ */
+#ifndef HAL_IOV_MAX
+#define HAL_IOV_MAX 4
+#endif
+
+/**
+ * Segment of a scatter-gather write.
+ */
+typedef struct _tHalIovec
+{
+  const void *base;
+  uint8_t len;
+} tHalIovec;
+
+/**
+ * Writes scattered data to a serial interface, without gathering it into a
+ * single buffer first.
+ *
+ * @param[in]  iov      segments, at most HAL_IOV_MAX
+ * @param[in]  iovcnt   number of segments
+ */
+void Hal_Writev_Serial(const tHalIovec *iov, uint8_t iovcnt);
+
+/**
+ * Hal_Writev_Serial() for a write that may already be partly done: nothing
+ * is written until min_bytes fit, instead of the whole first segment.
+ *
+ * @param[in]  iov       segments, at most HAL_IOV_MAX
+ * @param[in]  iovcnt    number of segments
+ * @param[in]  min_bytes write nothing unless this many bytes fit
+ * @return 0 if all was written, <0 if the controller timed out
+ */
+int32_t Hal_Writev_Serial_Min(const tHalIovec *iov, uint8_t iovcnt, uint8_t min_bytes);
+
+/**
+ * Single attempt of Hal_Writev_Serial(), returning without waiting for the
+ * BLE controller to wake up or to have room.
+ *
+ * @param[in]  iov       segments, at most HAL_IOV_MAX
+ * @param[in]  iovcnt    number of segments
+ * @param[in]  min_bytes write nothing unless this many bytes fit
+ * @return number of bytes written, <0 if the controller is not ready
+ */
+int32_t Hal_Try_Writev_Serial(const tHalIovec *iov, uint8_t iovcnt, uint8_t min_bytes);
+
 /**
  * Enable interrupts from HCI controller.
  */
@@ -33,15 +33,73 @@
 
 #define HCI_LOG_ON 0
 
-#define HCI_READ_PACKET_NUM_MAX 		 (2)
-
 #define MIN(a,b)            ((a) < (b) )? (a) : (b)
 #define MAX(a,b)            ((a) > (b) )? (a) : (b)
 
-tListNode hciReadPktPool;
-tListNode hciReadPktRxQueue;
-/* pool of hci read packets */
+#if (HCI_READ_PACKET_NUM_MAX & (HCI_READ_PACKET_NUM_MAX - 1)) != 0 || HCI_READ_PACKET_NUM_MAX > 128
+#error "HCI_READ_PACKET_NUM_MAX must be a power of 2, at most 128"
+#endif
+
+#if HCI_WRITE_PACKET_SIZE > 255
+#error "HCI_WRITE_PACKET_SIZE must be at most 255"
+#endif
+
+/* Ring of hci read packets, single producer (HCI_Isr) and single consumer
+   (HCI_Process and hci_send_req, main loop). Slots [hciRxTail, hciRxHead) are
+   queued, the others belong to the producer. The indices run freely and wrap
+   at 256. No interrupt masking: each index has a single writer and a barrier
+   orders the packet contents against the index update. */
 static tHciDataPacket     hciReadPacketBuffer[HCI_READ_PACKET_NUM_MAX];
+/* Set by the consumer for queued packets it is done with. hci_send_req() takes
+   its response out of order, the slot is released once it reaches the tail. */
+static uint8_t            hciReadPacketConsumed[HCI_READ_PACKET_NUM_MAX];
+static volatile uint8_t   hciRxHead;
+static volatile uint8_t   hciRxTail;
+/* HCI_Isr() is called from the EXTI interrupt and explicitly from the main loop */
+static volatile uint8_t   hciIsrActive;
+/* ring statistics, updated from HCI_Isr() and hci_send_req() */
+static volatile tHciStats hciStats;
+
+/* asynchronous commands awaiting completion, in the order they were sent */
+typedef struct _tHciPendingCmd
+{
+  uint16_t opcode;
+  int event;
+  uint8_t status_received;  /* EVT_CMD_STATUS received, waiting for r->event */
+  hci_cmd_cb_t cb;
+  void *cb_data;
+  struct timer t;
+} tHciPendingCmd;
+
+static tHciPendingCmd     hciPendingCmd[HCI_PENDING_CMD_NUM_MAX];
+static uint8_t            hciPendingCmdNum;
+
+/* asynchronous commands not written yet, in the order they were sent, the
+   rest of each is copied here once a write attempt fails */
+typedef struct _tHciWritePacket
+{
+  uint8_t dataBuff[HCI_WRITE_PACKET_SIZE];
+  uint8_t data_len;
+  uint8_t data_off;   /* bytes written already */
+  uint8_t min_bytes;  /* the header goes in a single transaction */
+} tHciWritePacket;
+
+static tHciWritePacket    hciWritePacket[HCI_WRITE_PACKET_NUM_MAX];
+static uint8_t            hciWritePacketNum;
+
+/* Command credits (Num_HCI_Command_Packets). HCI_Isr() stores the count of
+   every EVT_CMD_COMPLETE and EVT_CMD_STATUS received and bumps the sequence
+   number, the main loop takes the count over when the sequence changed and
+   spends one credit per command written. Each variable has a single writer. */
+static volatile uint8_t   hciCmdCreditsRx;
+static volatile uint8_t   hciCmdCreditsSeq;
+static uint8_t            hciCmdCreditsAck;
+static uint8_t            hciCmdCredits;
+
+#define HCI_RX_INDEX(i)     ((uint8_t)(i) & (HCI_READ_PACKET_NUM_MAX - 1))
+#define HCI_RX_SLOT(i)      (&hciReadPacketBuffer[HCI_RX_INDEX(i)])
+#define HCI_RX_CONSUMED(i)  (hciReadPacketConsumed[HCI_RX_INDEX(i)])
+#define HCI_RX_USED()       ((uint8_t)(hciRxHead - hciRxTail))
 
 static volatile uint8_t hci_timer_id;
 static volatile uint8_t hci_timeout;
@@ -54,17 +112,29 @@ void hci_timeout_callback(void)
 
 void HCI_Init(void)
 {
-  uint8_t index;
+  hciRxHead = 0;
+  hciRxTail = 0;
+  hciIsrActive = 0;
+  hciPendingCmdNum = 0;
+  hciWritePacketNum = 0;
+  /* a single command until the BlueNRG tells otherwise */
+  hciCmdCreditsRx = 1;
+  hciCmdCreditsSeq = 0;
+  hciCmdCreditsAck = 0;
+  hciCmdCredits = 1;
   
-  /* Initialize list heads of ready and free hci data packet queues */
-  list_init_head (&hciReadPktPool);
-  list_init_head (&hciReadPktRxQueue);
-  
-  /* Initialize the queue of free hci data packets */
-  for (index = 0; index < HCI_READ_PACKET_NUM_MAX; index++)
-  {
-    list_insert_tail(&hciReadPktPool, (tListNode *)&hciReadPacketBuffer[index]);
-  }
+  HCI_Clear_Stats();
+}
+
+void HCI_Get_Stats(tHciStats *stats)
+{
+  Osal_MemCpy(stats, (const void *)&hciStats, sizeof(hciStats));
+}
+
+void HCI_Clear_Stats(void)
+{
+  Osal_MemSet((void *)&hciStats, 0, sizeof(hciStats));
+  hciStats.pool_size = HCI_READ_PACKET_NUM_MAX;
 }
 
 #define HCI_PCK_TYPE_OFFSET                 0
@@ -80,131 +150,560 @@ int HCI_verify(const tHciDataPacket * hciReadPacket)
 {
   const uint8_t *hci_pckt = hciReadPacket->dataBuff;
   
-  if(hci_pckt[HCI_PCK_TYPE_OFFSET] != HCI_EVENT_PKT)
+  if(hci_pckt[HCI_PCK_TYPE_OFFSET] != HCI_EVENT_PKT){
+    hciStats.n_verify_type++;
     return 1;  /* Incorrect type. */
+  }
   
-  if(hci_pckt[EVENT_PARAMETER_TOT_LEN_OFFSET] != hciReadPacket->data_len - (1+HCI_EVENT_HDR_SIZE))
+  if(hci_pckt[EVENT_PARAMETER_TOT_LEN_OFFSET] != hciReadPacket->data_len - (1+HCI_EVENT_HDR_SIZE)){
+    hciStats.n_verify_len++;
     return 2; /* Wrong length (packet truncated or too long). */
+  }
   
   return 0;      
 }
 
+/* Hand consumed packets at the tail back to the producer. */
+static void hci_rx_release(void)
+{
+  uint8_t tail = hciRxTail;
+  
+  while(tail != hciRxHead && HCI_RX_CONSUMED(tail))
+    tail++;
+  /* done with the packet contents before the producer may reuse the slots */
+  __DMB();
+  hciRxTail = tail;
+}
+
+static int hci_cmd_match(const tHciDataPacket *hciReadPacket, int claim_only);
+
+/* Deliver queued packet i if it completes an asynchronous command. The slot is
+   released first and the completion delivered from a copy, the callback may
+   send commands. Returns 1 if it was delivered. */
+static int hci_rx_deliver(uint8_t i)
+{
+  tHciDataPacket pckt;
+  
+  if(!hci_cmd_match(HCI_RX_SLOT(i), 1))
+    return 0;
+  
+  Osal_MemCpy(&pckt, HCI_RX_SLOT(i), sizeof(pckt));
+  HCI_RX_CONSUMED(i) = 1;
+  hci_rx_release();
+  hci_cmd_match(&pckt, 0);
+  return 1;
+}
+
+/* Free the oldest queued packet, completions of asynchronous commands are
+   delivered rather than dropped. Returns 0 if there is none left, 1 if an
+   event was dropped, 2 if a completion was delivered. */
+static int hci_rx_drop_oldest(void)
+{
+  uint8_t i;
+  
+  for(i = hciRxTail; i != hciRxHead; i++){
+    if(!HCI_RX_CONSUMED(i)){
+      if(hci_rx_deliver(i))
+        return 2;
+      HCI_RX_CONSUMED(i) = 1;
+      hci_rx_release();
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Remove pending command i and call its callback. */
+static void hci_cmd_complete(uint8_t i, uint8_t status, const uint8_t *rparam, uint8_t rlen)
+{
+  tHciPendingCmd cmd = hciPendingCmd[i];
+  
+  hciPendingCmdNum--;
+  for(; i < hciPendingCmdNum; i++)
+    hciPendingCmd[i] = hciPendingCmd[i + 1];
+  
+  /* called last, it may send further commands */
+  if(cmd.cb != NULL)
+    cmd.cb(status, rparam, rlen, cmd.cb_data);
+}
+
+/* First pending command waiting for opcode, HCI_PENDING_CMD_NUM_MAX if none. */
+static uint8_t hci_cmd_find(uint16_t opcode)
+{
+  uint8_t i;
+  
+  for(i = 0; i < hciPendingCmdNum; i++){
+    if(hciPendingCmd[i].opcode == opcode && !hciPendingCmd[i].status_received)
+      return i;
+  }
+  return HCI_PENDING_CMD_NUM_MAX;
+}
+
+/* Match an event to a pending command, as hci_send_req() does.
+   Returns 1 if the event was consumed, or with claim_only if it would be
+   (nothing is changed then). */
+static int hci_cmd_match(const tHciDataPacket *hciReadPacket, int claim_only)
+{
+  const hci_uart_pckt *hci_hdr = (const void *)hciReadPacket->dataBuff;
+  const hci_event_pckt *event_pckt = (const void *)hci_hdr->data;
+  const uint8_t *ptr = hciReadPacket->dataBuff + (1 + HCI_EVENT_HDR_SIZE);
+  int len = hciReadPacket->data_len - (1 + HCI_EVENT_HDR_SIZE);
+  const evt_cmd_complete *cc;
+  const evt_cmd_status *cs;
+  const evt_le_meta_event *me;
+  uint8_t i;
+  
+  if(hciPendingCmdNum == 0)
+    return 0;
+  
+  switch(event_pckt->evt){
+    
+  case EVT_CMD_STATUS:
+    cs = (const void *)ptr;
+    i = hci_cmd_find(cs->opcode);
+    if(i == HCI_PENDING_CMD_NUM_MAX)
+      return 0;
+    if(claim_only)
+      return 1;
+    
+    if(hciPendingCmd[i].event != EVT_CMD_STATUS && !cs->status){
+      /* command accepted, the completion comes as r->event */
+      hciPendingCmd[i].status_received = 1;
+      return 1;
+    }
+    hci_cmd_complete(i, cs->status, ptr, len);
+    return 1;
+    
+  case EVT_CMD_COMPLETE:
+    cc = (const void *)ptr;
+    i = hci_cmd_find(cc->opcode);
+    if(i == HCI_PENDING_CMD_NUM_MAX)
+      return 0;
+    if(claim_only)
+      return 1;
+    
+    ptr += EVT_CMD_COMPLETE_SIZE;
+    len -= EVT_CMD_COMPLETE_SIZE;
+    hci_cmd_complete(i, len > 0 ? ptr[0] : BLE_STATUS_SUCCESS, ptr, len);
+    return 1;
+    
+  case EVT_LE_META_EVENT:
+    me = (const void *)ptr;
+    for(i = 0; i < hciPendingCmdNum; i++){
+      if(hciPendingCmd[i].status_received && hciPendingCmd[i].event == me->subevent){
+        if(claim_only)
+          return 1;
+        len -= 1;
+        hci_cmd_complete(i, len > 0 ? me->data[0] : BLE_STATUS_SUCCESS, me->data, len);
+        return 1;
+      }
+    }
+    return 0;
+    
+  default:
+    return 0;
+  }
+}
+
+/* Record the command credits of a packet received, from HCI_Isr(). */
+static void hci_cmd_credits_rx(const tHciDataPacket *hciReadPacket)
+{
+  const uint8_t *ptr = hciReadPacket->dataBuff + (1 + HCI_EVENT_HDR_SIZE);
+  int len = hciReadPacket->data_len - (1 + HCI_EVENT_HDR_SIZE);
+  
+  if(hciReadPacket->dataBuff[HCI_PCK_TYPE_OFFSET] != HCI_EVENT_PKT)
+    return;
+  
+  switch(hciReadPacket->dataBuff[1]){
+  case EVT_CMD_COMPLETE:
+    if(len < EVT_CMD_COMPLETE_SIZE)
+      return;
+    hciCmdCreditsRx = ((const evt_cmd_complete *)ptr)->ncmd;
+    break;
+  case EVT_CMD_STATUS:
+    if(len < EVT_CMD_STATUS_SIZE)
+      return;
+    hciCmdCreditsRx = ((const evt_cmd_status *)ptr)->ncmd;
+    break;
+  default:
+    return;
+  }
+  /* count written before the sequence number */
+  __DMB();
+  hciCmdCreditsSeq++;
+}
+
+/* Command credits left, after taking over the latest count received. */
+static uint8_t hci_cmd_credits(void)
+{
+  uint8_t seq = hciCmdCreditsSeq;
+  
+  if(seq != hciCmdCreditsAck){
+    /* sequence number read before the count */
+    __DMB();
+    hciCmdCredits = hciCmdCreditsRx;
+    hciCmdCreditsAck = seq;
+  }
+  return hciCmdCredits;
+}
+
+/* Wait for a command credit and spend it. A credit not coming within
+   DEFAULT_TIMEOUT is taken as lost, the command is written regardless. */
+static void hci_cmd_credit_wait(void)
+{
+  struct timer t;
+  
+  if(hci_cmd_credits() == 0){
+    Timer_Set(&t, DEFAULT_TIMEOUT);
+    /* Explicit call to HCI_Isr(), the credit comes with a completion */
+    while(hci_cmd_credits() == 0 && !Timer_Expired(&t))
+      HCI_Isr();
+    if(hciCmdCredits == 0)
+      hciStats.n_credit_timeout++;
+  }
+  if(hciCmdCredits > 0)
+    hciCmdCredits--;
+}
+
+/* Complete the commands pending for longer than DEFAULT_TIMEOUT. */
+static void hci_cmd_expire(void)
+{
+  uint8_t i = 0;
+  
+  while(i < hciPendingCmdNum){
+    if(Timer_Expired(&hciPendingCmd[i].t)){
+      hciStats.n_cmd_timeout++;
+      /* its completion, and the credit in it, is not coming */
+      if(hciCmdCredits == 0)
+        hciCmdCredits = 1;
+      hci_cmd_complete(i, BLE_STATUS_TIMEOUT, NULL, 0);
+      /* the callback may have sent commands, start over */
+      i = 0;
+      continue;
+    }
+    i++;
+  }
+}
+
+uint8_t HCI_Cmd_Pending(void)
+{
+  return hciPendingCmdNum;
+}
+
+/* Drop the first skip bytes of the n segments of iov. Returns the number of
+   segments left. */
+static uint8_t hci_iov_skip(tHalIovec *iov, uint8_t n, int32_t skip)
+{
+  uint8_t i = 0, j;
+  
+  while(i < n && skip >= iov[i].len){
+    skip -= iov[i].len;
+    i++;
+  }
+  for(j = 0; i < n; i++, j++)
+    iov[j] = iov[i];
+  if(j > 0){
+    iov[0].base = (const uint8_t *)iov[0].base + skip;
+    iov[0].len -= skip;
+  }
+  return j;
+}
+
+/* Write the queued commands in order, as far as the BlueNRG takes them and
+   the command credits allow without waiting. Returns 1 if none is left. */
+static int hci_write_drain(void)
+{
+  tHciWritePacket *w;
+  tHalIovec iov;
+  int32_t ret;
+  uint8_t i;
+  
+  while(hciWritePacketNum > 0){
+    w = &hciWritePacket[0];
+    /* the header is not written yet, the command needs a credit */
+    if(w->min_bytes && hci_cmd_credits() == 0)
+      return 0;
+    iov.base = w->dataBuff + w->data_off;
+    iov.len = w->data_len - w->data_off;
+    ret = Hal_Try_Writev_Serial(&iov, 1, w->min_bytes);
+    if(ret <= 0)
+      return 0;
+    if(w->min_bytes)
+      hciCmdCredits--;
+    w->data_off += ret;
+    w->min_bytes = 0;
+    if(w->data_off < w->data_len)
+      return 0;
+    
+    hciWritePacketNum--;
+    for(i = 0; i < hciWritePacketNum; i++)
+      hciWritePacket[i] = hciWritePacket[i + 1];
+  }
+  return 1;
+}
+
+/* Write the queued commands, waiting for the BlueNRG and the command credits.
+   Anything else written goes after them. A command the BlueNRG does not take
+   in time is dropped and counted, its completion (if any) expires. */
+static void hci_write_flush(void)
+{
+  tHciWritePacket *w;
+  tHalIovec iov;
+  uint8_t i;
+  
+  if(hci_write_drain())
+    return;
+  
+  for(i = 0; i < hciWritePacketNum; i++){
+    w = &hciWritePacket[i];
+    iov.base = w->dataBuff + w->data_off;
+    iov.len = w->data_len - w->data_off;
+    if(w->min_bytes)
+      hci_cmd_credit_wait();
+    if(Hal_Writev_Serial_Min(&iov, 1, w->min_bytes) < 0)
+      hciStats.n_write_dropped++;
+  }
+  hciWritePacketNum = 0;
+}
+
+uint8_t HCI_Write_Pending(void)
+{
+  return hciWritePacketNum;
+}
+
 void HCI_Process(void)
 {
-  tHciDataPacket * hciReadPacket = NULL;
+  uint8_t tail;
+  tHciDataPacket pckt;
+  
+  /* commands deferred while the BlueNRG was waking up */
+  hci_write_drain();
   
-  Disable_SPI_IRQ();
-  uint8_t list_empty = list_is_empty(&hciReadPktRxQueue);        
   /* process any pending events read */
-  while(list_empty == FALSE)
+  while((tail = hciRxTail) != hciRxHead)
   {
-    list_remove_head (&hciReadPktRxQueue, (tListNode **)&hciReadPacket);
-    Enable_SPI_IRQ();
-    HCI_Event_CB(hciReadPacket->dataBuff);
-    Disable_SPI_IRQ();
-    list_insert_tail(&hciReadPktPool, (tListNode *)hciReadPacket);
-    list_empty = list_is_empty(&hciReadPktRxQueue);
+    /* head read before the packet contents */
+    __DMB();
+    if(HCI_RX_CONSUMED(tail)){
+      hci_rx_release();
+      continue;
+    }
+    /* the slot is released before the callbacks run, they may send commands
+       whose responses need room in the ring */
+    Osal_MemCpy(&pckt, HCI_RX_SLOT(tail), sizeof(pckt));
+    HCI_RX_CONSUMED(tail) = 1;
+    hci_rx_release();
+    /* completions of asynchronous commands do not reach the application */
+    if(!hci_cmd_match(&pckt, 0))
+      HCI_Event_CB(pckt.dataBuff);
   }
+  hci_cmd_expire();
   /* Explicit call to HCI_Isr(), since it cannot be called by ISR if IRQ is kept high by
   BlueNRG. */
   HCI_Isr();
-  Enable_SPI_IRQ();    
 }
 
 BOOL HCI_Queue_Empty(void)
 {
-  return list_is_empty(&hciReadPktRxQueue);
+  return hciRxTail == hciRxHead;
 }
 
 void HCI_Isr(void)
 {
   tHciDataPacket * hciReadPacket = NULL;
-  uint8_t data_len;
+  uint8_t head, in_use;
+  int32_t data_len;
   
-  Clear_SPI_EXTI_Flag();
-  while(BlueNRG_DataPresent()){        
-    if (list_is_empty (&hciReadPktPool) == FALSE){
-      
-      /* enqueueing a packet for read */
-      list_remove_head (&hciReadPktPool, (tListNode **)&hciReadPacket);
+  /* An interrupt landing in an explicit call returns, the interrupted call
+     keeps draining. */
+  if(hciIsrActive)
+    return;
+  
+  do {
+    hciIsrActive = 1;
+    
+    Clear_SPI_EXTI_Flag();
+    while(BlueNRG_DataPresent()){
+      head = hciRxHead;
+      if((uint8_t)(head - hciRxTail) >= HCI_READ_PACKET_NUM_MAX){
+        // HCI read packet ring is full, wait for a free packet.
+        hciStats.n_stalled++;
+        break;
+      }
+      /* tail read before the slot is overwritten */
+      __DMB();
       
+      hciReadPacket = HCI_RX_SLOT(head);
       data_len = BlueNRG_SPI_Read_All(hciReadPacket->dataBuff, HCI_READ_PACKET_SIZE);
-      if(data_len > 0){                    
+      if(data_len > 0){
         hciReadPacket->data_len = data_len;
-        if(HCI_verify(hciReadPacket) == 0)
-          list_insert_tail(&hciReadPktRxQueue, (tListNode *)hciReadPacket);
-        else
-          list_insert_head(&hciReadPktPool, (tListNode *)hciReadPacket);          
-      }
-      else {
-        // Insert the packet back into the pool.
-        list_insert_head(&hciReadPktPool, (tListNode *)hciReadPacket);
+        if(HCI_verify(hciReadPacket) == 0){
+          hci_cmd_credits_rx(hciReadPacket);
+          HCI_RX_CONSUMED(head) = 0;
+          /* packet contents written before it is published */
+          __DMB();
+          hciRxHead = head + 1;
+          
+          hciStats.n_received++;
+          /* packets queued or held by the consumer */
+          in_use = (uint8_t)(head + 1 - hciRxTail);
+          if(in_use > hciStats.max_in_use)
+            hciStats.max_in_use = in_use;
+        }
       }
       
-    }
-    else{
-      // HCI Read Packet Pool is empty, wait for a free packet.
       Clear_SPI_EXTI_Flag();
-      return;
     }
     
-    Clear_SPI_EXTI_Flag();
-  }
+    hciIsrActive = 0;
+    /* retry if an edge was missed while active */
+  } while(BlueNRG_DataPresent() && HCI_RX_USED() < HCI_READ_PACKET_NUM_MAX);
 }
 
-void hci_write(const void* data1, const void* data2, uint8_t n_bytes1, uint8_t n_bytes2){
+void hci_writev(const tHalIovec *iov, uint8_t iovcnt){
 #if  HCI_LOG_ON
   PRINTF("HCI <- ");
-  for(int i=0; i < n_bytes1; i++)
-    PRINTF("%02X ", *((uint8_t*)data1 + i));
-  for(int i=0; i < n_bytes2; i++)
-    PRINTF("%02X ", *((uint8_t*)data2 + i));
+  for(int j=0; j < iovcnt; j++)
+    for(int i=0; i < iov[j].len; i++)
+      PRINTF("%02X ", *((uint8_t*)iov[j].base + i));
   PRINTF("\n");    
 #endif
   
-  Hal_Write_Serial(data1, data2, n_bytes1, n_bytes2);
+  hci_write_flush();
+  /* NOTE the host writes commands only, data goes through the GATT commands */
+  if(iovcnt > 0)
+    hci_cmd_credit_wait();
+  if(iovcnt > 0 && Hal_Writev_Serial_Min(iov, iovcnt, iov[0].len) < 0)
+    hciStats.n_write_dropped++;
 }
 
-void hci_send_cmd(uint16_t ogf, uint16_t ocf, uint8_t plen, void *param)
+void hci_write(const void* data1, const void* data2, uint8_t n_bytes1, uint8_t n_bytes2){
+  const tHalIovec iov[2] = {
+    { data1, n_bytes1 },
+    { data2, n_bytes2 }
+  };
+  
+  hci_writev(iov, 2);
+}
+
+/* Command packet as the header followed by the n parameter segments. Returns
+   the number of segments of iov, 0 if there are too many. */
+static uint8_t hci_cmd_iov(uint16_t ogf, uint16_t ocf, const tHalIovec *param, uint8_t n,
+                           uint8_t header[HCI_HDR_SIZE + HCI_COMMAND_HDR_SIZE], tHalIovec *iov)
 {
   hci_command_hdr hc;
+  uint8_t plen = 0;
+  uint8_t i;
+  
+  if(n > HAL_IOV_MAX - 1)
+    return 0;
+  
+  for(i = 0; i < n; i++){
+    iov[1 + i] = param[i];
+    plen += param[i].len;
+  }
   
   hc.opcode = htobs(cmd_opcode_pack(ogf, ocf));
   hc.plen= plen;
   
-  uint8_t header[HCI_HDR_SIZE + HCI_COMMAND_HDR_SIZE];
   header[0] = HCI_COMMAND_PKT;
   Osal_MemCpy(header+1, &hc, sizeof(hc));
   
-  hci_write(header, param, sizeof(header), plen);
+  iov[0].base = header;
+  iov[0].len = HCI_HDR_SIZE + HCI_COMMAND_HDR_SIZE;
+  return 1 + n;
+}
+
+void hci_send_cmdv(uint16_t ogf, uint16_t ocf, const tHalIovec *param, uint8_t n)
+{
+  uint8_t header[HCI_HDR_SIZE + HCI_COMMAND_HDR_SIZE];
+  tHalIovec iov[HAL_IOV_MAX];
+  
+  n = hci_cmd_iov(ogf, ocf, param, n, header, iov);
+  if(n == 0)
+    return;
+  hci_writev(iov, n);
 }
 
-static void move_list(tListNode * dest_list, tListNode * src_list)
+void hci_send_cmd(uint16_t ogf, uint16_t ocf, uint8_t plen, void *param)
+{
+  const tHalIovec iov = { param, plen };
+  
+  hci_send_cmdv(ogf, ocf, &iov, 1);
+}
+
+static void hci_send_req_cmd(const struct hci_request *r)
+{
+  if(r->ciovcnt)
+    hci_send_cmdv(r->ogf, r->ocf, r->ciov, r->ciovcnt);
+  else
+    hci_send_cmd(r->ogf, r->ocf, r->clen, r->cparam);
+}
+
+/* As hci_send_req_cmd(), without waiting for the BlueNRG to wake up or for a
+   command credit: what it does not take right away is queued for
+   HCI_Process(). Commands not fitting the queue are written in place. */
+static void hci_send_req_cmd_async(const struct hci_request *r)
 {
-  pListNode tmp_node;
+  uint8_t header[HCI_HDR_SIZE + HCI_COMMAND_HDR_SIZE];
+  tHalIovec iov[HAL_IOV_MAX];
+  const tHalIovec param = { r->cparam, (uint8_t)r->clen };
+  tHciWritePacket *w;
+  int32_t ret = 0;
+  uint16_t len = 0;
+  uint8_t n, i;
+  
+  if(r->ciovcnt)
+    n = hci_cmd_iov(r->ogf, r->ocf, r->ciov, r->ciovcnt, header, iov);
+  else
+    n = hci_cmd_iov(r->ogf, r->ocf, &param, 1, header, iov);
+  if(n == 0)
+    return;
+  
+  /* nothing queued to go first */
+  if(hciWritePacketNum == 0 && hci_cmd_credits() > 0){
+    ret = Hal_Try_Writev_Serial(iov, n, sizeof(header));
+    if(ret < 0)
+      ret = 0;
+    if(ret > 0)
+      hciCmdCredits--;
+  }
+  n = hci_iov_skip(iov, n, ret);
+  if(n == 0)
+    return;
   
-  while(!list_is_empty(src_list)){
-    list_remove_tail(src_list, &tmp_node);
-    list_insert_head(dest_list, tmp_node);
+  for(i = 0; i < n; i++)
+    len += iov[i].len;
+  if(hciWritePacketNum >= HCI_WRITE_PACKET_NUM_MAX || len > HCI_WRITE_PACKET_SIZE){
+    hci_writev(iov, n);
+    return;
   }
+  
+  w = &hciWritePacket[hciWritePacketNum++];
+  w->data_len = 0;
+  w->data_off = 0;
+  w->min_bytes = ret == 0 ? sizeof(header) : 0;
+  for(i = 0; i < n; i++){
+    Osal_MemCpy(w->dataBuff + w->data_len, iov[i].base, iov[i].len);
+    w->data_len += iov[i].len;
+  }
+  hciStats.n_cmd_deferred++;
 }
 
- /* It ensures that we have at least half of the free buffers in the pool. */
+/* It ensures that we have at least half of the free buffers in the ring. */
 static void free_event_list(void)
 {
-  tHciDataPacket * pckt;
-    
-  Disable_SPI_IRQ();
+  int ret;
   
-  while(list_get_size(&hciReadPktPool) < HCI_READ_PACKET_NUM_MAX/2){
-    list_remove_head(&hciReadPktRxQueue, (tListNode **)&pckt);    
-    list_insert_tail(&hciReadPktPool, (tListNode *)pckt);
+  while(HCI_RX_USED() > HCI_READ_PACKET_NUM_MAX - HCI_READ_PACKET_NUM_MAX/2){
+    if(!(ret = hci_rx_drop_oldest()))
+      break;
+    if(ret == 1)
+      hciStats.n_recycled++;
     /* Explicit call to HCI_Isr(), since it cannot be called by ISR if IRQ is kept high by
     BlueNRG */
     HCI_Isr();
   }
-  
-  Enable_SPI_IRQ();
 }
 
 int hci_send_req(struct hci_request *r, BOOL async)
@@ -216,13 +715,12 @@ int hci_send_req(struct hci_request *r, BOOL async)
   int to = DEFAULT_TIMEOUT;
   struct timer t;
   tHciDataPacket * hciReadPacket = NULL;
-  tListNode hciTempQueue;
-  
-  list_init_head(&hciTempQueue);
+  /* next queued packet to look at, the ones before it are left to the application */
+  uint8_t scan;
 
   free_event_list();
   
-  hci_send_cmd(r->ogf, r->ocf, r->clen, r->cparam);
+  hci_send_req_cmd(r);
   
   if(async){
     return 0;
@@ -234,6 +732,7 @@ int hci_send_req(struct hci_request *r, BOOL async)
   
   Timer_Set(&t, to);
   
+  scan = hciRxTail;
   while(1) {
     evt_cmd_complete *cc;
     evt_cmd_status *cs;
@@ -242,16 +741,37 @@ int hci_send_req(struct hci_request *r, BOOL async)
       
     while(1){
       if(Timer_Expired(&t)){
+        /* the credit in the response is not coming either */
+        if(hciCmdCredits == 0)
+          hciCmdCredits = 1;
         goto failed;
       }
-      if(!HCI_Queue_Empty()){
+      /* skip packets already consumed, e.g. responses taken out of order */
+      while(scan != hciRxHead && HCI_RX_CONSUMED(scan))
+        scan++;
+      if(scan != hciRxHead){
         break;
       }
+      /* If there are no more packets to be processed, be sure there is at least one
+         free slot to receive the expected event, discarding the oldest event if needed. */
+      if(HCI_RX_USED() >= HCI_READ_PACKET_NUM_MAX && hci_rx_drop_oldest() == 1)
+        hciStats.n_discarded++;
+      /* Explicit call to HCI_Isr(), since it cannot be called by ISR if IRQ is kept high by
+      BlueNRG */
+      HCI_Isr();
     }
     
-    /* Extract packet from HCI event queue. */
-    Disable_SPI_IRQ();
-    list_remove_head(&hciReadPktRxQueue, (tListNode **)&hciReadPacket);    
+    /* head read before the packet contents */
+    __DMB();
+    
+    /* Completion of an asynchronous command: those were sent earlier, a
+       completion of the same opcode is theirs first. */
+    if(hci_rx_deliver(scan)){
+      scan++;
+      continue;
+    }
+    
+    hciReadPacket = HCI_RX_SLOT(scan);
     
     hci_hdr = (void *)hciReadPacket->dataBuff;
 
@@ -313,43 +833,44 @@ int hci_send_req(struct hci_request *r, BOOL async)
       }
     }
     
-    /* If there are no more packets to be processed, be sure there is at list one
-       packet in the pool to process the expected event.
-       If no free packets are available, discard the processed event and insert it
-       into the pool. */
-    if(list_is_empty(&hciReadPktPool) && list_is_empty(&hciReadPktRxQueue)){
-      list_insert_tail(&hciReadPktPool, (tListNode *)hciReadPacket);
-      hciReadPacket=NULL;
-    }
-    else {
-      /* Insert the packet in a different queue. These packets will be
-      inserted back in the main queue just before exiting from send_req(), so that
-      these events can be processed by the application.
-    */
-    list_insert_tail(&hciTempQueue, (tListNode *)hciReadPacket);
-      hciReadPacket=NULL;
-    }
-
-    HCI_Isr();
-    
-    Enable_SPI_IRQ();
-    
+    /* Leave the packet in the ring, so that the application can process it. */
+    hciReadPacket=NULL;
+    scan++;
   }
   
 failed: 
   if(hciReadPacket!=NULL){
-    list_insert_head(&hciReadPktPool, (tListNode *)hciReadPacket);
+    HCI_RX_CONSUMED(scan) = 1;
+    hci_rx_release();
   }
-  move_list(&hciReadPktRxQueue, &hciTempQueue);  
-  Enable_SPI_IRQ();
   return -1;
   
 done:
-  // Insert the packet back into the pool.
-  list_insert_head(&hciReadPktPool, (tListNode *)hciReadPacket); 
-  move_list(&hciReadPktRxQueue, &hciTempQueue);
+  // Hand the packet back to the producer.
+  HCI_RX_CONSUMED(scan) = 1;
+  hci_rx_release();
+  return 0;
+}
+
+int hci_send_req_cb(struct hci_request *r, hci_cmd_cb_t cb, void *cb_data)
+{
+  tHciPendingCmd *cmd;
+  
+  if(hciPendingCmdNum >= HCI_PENDING_CMD_NUM_MAX)
+    return -1;
+  
+  free_event_list();
+  
+  cmd = &hciPendingCmd[hciPendingCmdNum++];
+  cmd->opcode = htobs(cmd_opcode_pack(r->ogf, r->ocf));
+  cmd->event = r->event;
+  cmd->status_received = 0;
+  cmd->cb = cb;
+  cmd->cb_data = cb_data;
+  Timer_Set(&cmd->t, DEFAULT_TIMEOUT);
   
-  Enable_SPI_IRQ();
+  hciStats.n_cmd_async++;
+  hci_send_req_cmd_async(r);
   return 0;
 }
 
@@ -19,9 +19,39 @@
 #include "hal_types.h"
 #include "link_layer.h"
 #include "ble_list.h"
+#include "hal.h"
 
 #define HCI_READ_PACKET_SIZE                    128 //71
 
+/**
+ * Number of HCI read packets in the ring. Override at build time if needed,
+ * must be a power of 2 (at most 128). Bursts of events (e.g. connection, MTU
+ * exchange and writes) need several packets queued between two calls to
+ * HCI_Process().
+ */
+#ifndef HCI_READ_PACKET_NUM_MAX
+#define HCI_READ_PACKET_NUM_MAX                 (4)
+#endif
+
+/**
+ * Number of asynchronous commands awaiting completion, see hci_send_req_cb().
+ */
+#ifndef HCI_PENDING_CMD_NUM_MAX
+#define HCI_PENDING_CMD_NUM_MAX                 (4)
+#endif
+
+/**
+ * Asynchronous commands waiting for the BlueNRG to wake up, written from
+ * HCI_Process(), and the size of each (header included, at most 255).
+ * Longer commands are written in place, waiting for the BlueNRG.
+ */
+#ifndef HCI_WRITE_PACKET_NUM_MAX
+#define HCI_WRITE_PACKET_NUM_MAX                (2)
+#endif
+#ifndef HCI_WRITE_PACKET_SIZE
+#define HCI_WRITE_PACKET_SIZE                   (64)
+#endif
+
 /**
  * Maximum payload of HCI commands that can be sent. Change this value if needed.
  * This value can be up to 255.
@@ -45,11 +75,30 @@
 /* structure used to read received data */
 typedef struct _tHciDataPacket
 {
-  tListNode currentNode;
   uint8_t dataBuff[HCI_READ_PACKET_SIZE];
   uint8_t data_len;
 } tHciDataPacket;
 
+/* HCI read packet ring statistics */
+typedef struct _tHciStats
+{
+  uint8_t  pool_size;
+  uint8_t  max_in_use;      /* high-water mark of queued packets */
+  uint32_t n_received;      /* packets queued for processing */
+  uint32_t n_stalled;       /* HCI_Isr() found the ring full, data left in BlueNRG */
+  uint32_t n_recycled;      /* queued events dropped to free packets before a command */
+  uint32_t n_discarded;     /* events dropped by hci_send_req() while waiting for a response */
+  uint32_t n_verify_type;   /* HCI_verify(): not an event packet */
+  uint32_t n_verify_len;    /* HCI_verify(): truncated or too long */
+  uint32_t n_cmd_async;     /* asynchronous commands sent */
+  uint32_t n_cmd_timeout;   /* asynchronous commands expired without completion */
+  uint32_t n_cmd_deferred;  /* asynchronous commands queued until the BlueNRG woke up
+                               or a command credit came */
+  uint32_t n_write_dropped; /* commands not (fully) written, the BlueNRG timed out */
+  uint32_t n_credit_timeout;/* commands written without a command credit, none came
+                               within DEFAULT_TIMEOUT */
+} tHciStats;
+
 struct hci_request {
   uint16_t ogf;
   uint16_t ocf;
@@ -58,8 +107,23 @@ struct hci_request {
   int      clen;
   void     *rparam;
   int      rlen;
+  /* scattered parameters, sent instead of cparam if ciovcnt is not 0 */
+  const tHalIovec *ciov;
+  uint8_t  ciovcnt;
 };
 
+/**
+ * Completion of an asynchronous command.
+ *
+ * @param status    BLE_STATUS_TIMEOUT if no completion was received, else the
+ *                  status returned by the controller (first response parameter).
+ * @param rparam    Response parameters, as copied to rparam by hci_send_req().
+ *                  Only valid during the call.
+ * @param rlen      Length of the response parameters.
+ * @param cb_data   As passed to hci_send_req_cb().
+ */
+typedef void (*hci_cmd_cb_t)(uint8_t status, const uint8_t *rparam, uint8_t rlen, void *cb_data);
+
 typedef enum
 {
   BUSY,
@@ -103,6 +167,18 @@ void HCI_Process(void);
  * @return TRUE if event queue is empty. FALSE otherwhise.
  */
 BOOL HCI_Queue_Empty(void);
+
+/**
+ * @brief Get the HCI read packet ring statistics.
+ * @param[out] stats    Copy of the statistics.
+ */
+void HCI_Get_Stats(tHciStats *stats);
+
+/**
+ * @brief Reset the HCI read packet ring statistics.
+ */
+void HCI_Clear_Stats(void);
+
 /**
  * Iterrupt service routine that must be called when the BlueNRG 
  * reports a packet received or an event to the host through the 
@@ -117,10 +193,38 @@ void HCI_Wait_For_Response(void);
 void HCI_Isr(void);
 
 int hci_send_req(struct hci_request *r, BOOL async);
-#endif /* __DMA_LP__ */
 
-extern tListNode hciReadPktPool;
-extern tListNode hciReadPktRxQueue;
+/**
+ * @brief Send a command without waiting for its completion.
+ * @note The command is sent right away, or from HCI_Process() once the
+ *       BlueNRG is awake and has a command credit (Num_HCI_Command_Packets
+ *       of the last EVT_CMD_COMPLETE or EVT_CMD_STATUS, see
+ *       HCI_Write_Pending()). The completion
+ *       (EVT_CMD_COMPLETE, EVT_CMD_STATUS or the LE meta event r->event) is
+ *       matched by opcode in HCI_Process(), which calls cb instead of
+ *       HCI_Event_CB, or in hci_send_req() while a blocking command waits
+ *       (completions go to the oldest pending command of their opcode, the
+ *       blocking one is the newest). A command not completed within
+ *       DEFAULT_TIMEOUT completes with BLE_STATUS_TIMEOUT on the next call
+ *       to HCI_Process().
+ *       r->rparam and r->rlen are unused, cb may be NULL.
+ * @return 0 if the command was sent, -1 if HCI_PENDING_CMD_NUM_MAX commands
+ *         are already pending.
+ */
+int hci_send_req_cb(struct hci_request *r, hci_cmd_cb_t cb, void *cb_data);
+
+/**
+ * @brief Number of asynchronous commands awaiting completion.
+ */
+uint8_t HCI_Cmd_Pending(void);
+
+/**
+ * @brief Number of asynchronous commands not written yet, the BlueNRG is
+ *        waking up. HCI_Process() retries them, it must be called again soon
+ *        (e.g. do not enter a sleep mode stopping the tick).
+ */
+uint8_t HCI_Write_Pending(void);
+#endif /* __DMA_LP__ */
 
 /**
  * @}
@@ -525,6 +525,8 @@ typedef __packed struct _evt_le_long_term_key_request{
 
 
 void hci_send_cmd(uint16_t ogf, uint16_t ocf, uint8_t plen, void *param);
+/* parameters scattered over at most HAL_IOV_MAX - 1 segments, sent without copy */
+void hci_send_cmdv(uint16_t ogf, uint16_t ocf, const tHalIovec *param, uint8_t n);
 
 typedef enum {
   WAITING_TYPE,
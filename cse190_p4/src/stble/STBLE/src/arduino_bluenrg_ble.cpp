@@ -71,6 +71,15 @@ extern volatile uint32_t ms_counter;
 #define MAX_BUFFER_SIZE 255
 #define TIMEOUT_DURATION 15
 
+#if defined(ARDUINO_ARCH_SAMD) && BNRG_SPI_DMA
+/* the DMAC descriptor table is indexed by channel */
+#define DMA_CH_RX 0
+#define DMA_CH_TX 1
+#define DMA_CH_NUM 2
+/* a 255 byte block takes 0.3 ms at 8 MHz, in SysTick periods (1 ms) */
+#define DMA_TIMEOUT_MS 2
+#endif
+
 /**
  * @}
  */
@@ -83,6 +92,20 @@ SPI_HandleTypeDef SpiHandle;
 
 SPIClass *BLESPI = &SPI;
 
+#if defined(ARDUINO_ARCH_SAMD) && BNRG_SPI_DMA
+/* NOTE the DMAC requires 128 bit aligned descriptors */
+static DmacDescriptor dma_desc[DMA_CH_NUM] __attribute__((aligned(16)));
+static DmacDescriptor dma_wb[DMA_CH_NUM] __attribute__((aligned(16)));
+/* set if the DMAC was free at init */
+static uint8_t dma_ok = 0;
+/* source of the dummy bytes sent while receiving, sink of the bytes ignored */
+static const uint8_t dma_tx_dummy = 0xFF;
+static uint8_t dma_rx_dummy;
+#endif
+
+/* nesting depth of Disable_SPI_IRQ, SPI busy while non zero */
+static volatile uint8_t spi_irq_disabled = 0;
+
 /**
  * @}
  */
@@ -93,6 +116,14 @@ SPIClass *BLESPI = &SPI;
 
 /* Private function prototypes -----------------------------------------------*/
 static void us150Delay(void);
+static void BlueNRG_Wait(void);
+#if defined(ARDUINO_ARCH_SAMD)
+static void BNRG_SPI_EXTI_Isr(void);
+#endif
+static void SPI_Transfer(const uint8_t *pTxData, uint8_t *pRxData, uint8_t Size);
+#if defined(ARDUINO_ARCH_SAMD) && BNRG_SPI_DMA
+static void SPI_DMA_Init(void);
+#endif
 void set_irq_as_output(void);
 void set_irq_as_input(void);
 
@@ -136,34 +167,103 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef* hspi)
  */
 void Hal_Write_Serial(const void* data1, const void* data2, int32_t n_bytes1,
                       int32_t n_bytes2)
+{
+  const tHalIovec iov[2] = {
+    { data1, (uint8_t)n_bytes1 },
+    { data2, (uint8_t)n_bytes2 }
+  };
+  
+  Hal_Writev_Serial(iov, 2);
+}
+
+/**
+ * @brief  Writes scattered data to a serial interface, without gathering
+ *         it into a single buffer first.
+ * @note   The first segment (e.g. the HCI header) goes out in a single SPI
+ *         transaction, the rest may be split if the BlueNRG buffer is short.
+ * @note   Sleeps between the attempts while BlueNRG wakes up or drains its
+ *         buffer, see BlueNRG_Wait.
+ * @param  iov    :  segments, at most HAL_IOV_MAX
+ * @param  iovcnt :  number of segments
+ * @retval None
+ */
+void Hal_Writev_Serial(const tHalIovec *iov, uint8_t iovcnt)
+{
+  if(iovcnt == 0)
+    return;
+  
+  Hal_Writev_Serial_Min(iov, iovcnt, iov[0].len);
+}
+
+/**
+ * @brief  Hal_Writev_Serial with the first transaction taking min_bytes
+ *         instead of the whole first segment.
+ * @param  iov       :  segments, at most HAL_IOV_MAX
+ * @param  iovcnt    :  number of segments
+ * @param  min_bytes :  write nothing unless this many bytes fit
+ * @retval 0 if all was written, -1 if BlueNRG timed out.
+ */
+int32_t Hal_Writev_Serial_Min(const tHalIovec *iov, uint8_t iovcnt, uint8_t min_bytes)
 {
   struct timer t;
-  int ret;
-  uint8_t data2_offset = 0;
+  int32_t ret;
+  tHalIovec rest[HAL_IOV_MAX];
+  uint8_t first = 0;
+  uint8_t i;
   
-  Timer_Set(&t, CLOCK_SECOND/10);
+  if(iovcnt == 0 || iovcnt > HAL_IOV_MAX)
+    return -1;
   
-  Disable_SPI_IRQ();
+  /* segments not written yet, starting from first */
+  for(i = 0; i < iovcnt; i++)
+    rest[i] = iov[i];
+  ret = -1;
   
+  Timer_Set(&t, CLOCK_SECOND/10);
+  
+  /* NOTE the IRQ stays enabled between the attempts, it wakes
+     BlueNRG_Wait; BlueNRG_SPI_Writev masks it during the transaction */
   while(1){
-    ret = BlueNRG_SPI_Write((uint8_t *)data1,(uint8_t *)data2 + data2_offset, n_bytes1, n_bytes2);
+    ret = BlueNRG_SPI_Writev(rest + first, iovcnt - first, min_bytes);
     
     if(ret >= 0){      
-      n_bytes1 = 0;
-      n_bytes2 -= ret;
-      data2_offset += ret;
-      if(n_bytes2==0)
+      min_bytes = 0;
+      /* skip the segments written, advance into a partly written one */
+      while(first < iovcnt && ret >= rest[first].len){
+        ret -= rest[first].len;
+        first++;
+      }
+      if(first == iovcnt){
+        ret = 0;
         break;
+      }
+      rest[first].base = (const uint8_t *)rest[first].base + ret;
+      rest[first].len -= ret;
     }
     
     if(Timer_Expired(&t)){
+      ret = -1;
       break;
     }
+    
+    /* BlueNRG waking up or short of buffer */
+    BlueNRG_Wait();
   }
   
-  Enable_SPI_IRQ();
+  return ret;
 }
 
+/**
+ * @brief  Single attempt of Hal_Writev_Serial, without waiting.
+ * @param  iov       :  segments, at most HAL_IOV_MAX
+ * @param  iovcnt    :  number of segments
+ * @param  min_bytes :  write nothing unless this many bytes fit
+ * @retval Number of bytes written, <0 if BlueNRG is not ready.
+ */
+int32_t Hal_Try_Writev_Serial(const tHalIovec *iov, uint8_t iovcnt, uint8_t min_bytes)
+{
+  return BlueNRG_SPI_Writev(iov, iovcnt, min_bytes);
+}
 /**
  * @brief  Initializes the SPI communication with the BlueNRG
  *         Expansion Board.
@@ -177,14 +277,16 @@ void BNRG_SPI_Init(void)
   pinMode(BNRG_SPI_EXTI_PIN,INPUT);
   
   BLESPI->begin();
-  BLESPI->setDataMode(SPI_MODE0);
-  BLESPI->setBitOrder(MSBFIRST);
+  /* NOTE the bus is not shared, the settings are kept after endTransaction */
+  BLESPI->beginTransaction(SPISettings(BNRG_SPI_CLOCK_HZ, MSBFIRST, SPI_MODE0));
+  BLESPI->endTransaction();
 #if defined(ARDUINO_ARCH_AVR)
-  BLESPI->setClockDivider(SPI_CLOCK_DIV8);
   attachInterrupt(0,HCI_Isr,RISING);
 #elif defined(ARDUINO_ARCH_SAMD)
-  BLESPI->setClockDivider(48);
-  attachInterrupt(BNRG_SPI_EXTI_PIN,HCI_Isr,RISING);
+  attachInterrupt(BNRG_SPI_EXTI_PIN,BNRG_SPI_EXTI_Isr,RISING);
+#endif
+#if defined(ARDUINO_ARCH_SAMD) && BNRG_SPI_DMA
+  SPI_DMA_Init();
 #endif
 
   //__HAL_SPI_ENABLE(&SpiHandle);
@@ -246,7 +348,7 @@ int32_t BlueNRG_SPI_Read_All(uint8_t *buffer, uint8_t buff_size)
   const uint8_t header_master[5] = {0x0b, 0x00, 0x00, 0x00, 0x00};
   uint8_t header_slave[5];
   
-  //__disable_irq();
+  Disable_SPI_IRQ();
   
   HAL_GPIO_WritePin(BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_RESET);
   
@@ -273,7 +375,7 @@ int32_t BlueNRG_SPI_Read_All(uint8_t *buffer, uint8_t buff_size)
   // Release CS line.
   HAL_GPIO_WritePin(BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_SET);
   
-  //__enable_irq();
+  Enable_SPI_IRQ();
   
 #ifdef PRINT_CSV_FORMAT
   if (len > 0) {
@@ -299,13 +401,39 @@ int32_t BlueNRG_SPI_Read_All(uint8_t *buffer, uint8_t buff_size)
  */
 int32_t BlueNRG_SPI_Write(uint8_t* data1, uint8_t* data2, uint8_t Nb_bytes1, uint8_t Nb_bytes2)
 {
-  int16_t result = 0;
-  uint16_t tx_bytes;
+  const tHalIovec iov[2] = {
+    { data1, Nb_bytes1 },
+    { data2, Nb_bytes2 }
+  };
+  int32_t result = BlueNRG_SPI_Writev(iov, 2, Nb_bytes1);
+  
+  /* bytes of data2 written */
+  if(result >= 0)
+    result -= Nb_bytes1;
+  return result;
+}
+
+/**
+ * @brief  Writes scattered data to BlueNRG, in a single SPI transaction.
+ * @param  iov       : segments
+ * @param  iovcnt    : number of segments
+ * @param  min_bytes : fail unless at least this many bytes fit in the
+ *                     BlueNRG buffer
+ * @retval Number of bytes written (at most the BlueNRG buffer space),
+ *         -1 if BlueNRG is not awake, -2 if min_bytes do not fit.
+ */
+int32_t BlueNRG_SPI_Writev(const tHalIovec *iov, uint8_t iovcnt, uint8_t min_bytes)
+{
+  int32_t result = 0;
+  uint8_t tx_bytes;
   uint8_t rx_bytes;
+  uint8_t i;
   
   const uint8_t header_master[5] = {0x0a, 0x00, 0x00, 0x00, 0x00};
   uint8_t header_slave[5]  = {0x00};
   
+  Disable_SPI_IRQ();
+  
   HAL_GPIO_WritePin(BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_RESET);
   
   HAL_SPI_TransmitReceive_Opt(header_master, header_slave, HEADER_SIZE);
@@ -317,33 +445,26 @@ int32_t BlueNRG_SPI_Write(uint8_t* data1, uint8_t* data2, uint8_t Nb_bytes1, uin
   
   rx_bytes = header_slave[1];
   
-  if(rx_bytes < Nb_bytes1){
+  if(rx_bytes < min_bytes){
     result = -2;
-    goto failed; // BlueNRG .      
+    goto failed; // BlueNRG buffer too short.
   }
   
-  HAL_SPI_Transmit_Opt(data1, Nb_bytes1);
-  
-  rx_bytes -= Nb_bytes1;
-  
-  if(Nb_bytes2 > rx_bytes){
-    tx_bytes = rx_bytes;
-  }
-  else{
-    tx_bytes = Nb_bytes2;
+  for(i = 0; i < iovcnt && rx_bytes > 0; i++){
+    tx_bytes = iov[i].len < rx_bytes ? iov[i].len : rx_bytes;
+    HAL_SPI_Transmit_Opt((const uint8_t *)iov[i].base, tx_bytes);
+    rx_bytes -= tx_bytes;
+    result += tx_bytes;
   }
   
-  HAL_SPI_Transmit_Opt(data2, tx_bytes);
-  
-  result = tx_bytes;
-  
 failed:
   
   // Release CS line
   HAL_GPIO_WritePin(BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_SET);
   
+  Enable_SPI_IRQ();
+  
   return result;
-
 }
       
 /**
@@ -378,23 +499,82 @@ static void us150Delay(void)
 }
 
 /**
- * @brief  Enable SPI IRQ.
+ * @brief  Waits for BlueNRG between two write attempts: sleeps until the
+ *         next interrupt, i.e. the IRQ edge (HCI_Isr) or the 1 ms tick
+ *         at the latest.
+ * @note   The BlueNRG-MS reports being awake in the SPI header only, the
+ *         CS assertion of the failed attempt has started its wake-up.
+ * @param  None
+ * @retval None
+ */
+static void BlueNRG_Wait(void)
+{
+#if defined(ARDUINO_ARCH_SAMD)
+  uint32_t scr = SCB->SCR;
+  
+  /* NOTE idle, SysTick and the EIC edge detection keep running */
+  SCB->SCR = scr & ~SCB_SCR_SLEEPDEEP_Msk;
+  PM->SLEEP.reg = PM_SLEEP_IDLE(PM_SLEEP_IDLE_CPU_Val);
+  __DSB();
+  __WFI();
+  SCB->SCR = scr;
+#endif
+}
+
+/**
+ * @brief  BlueNRG IRQ line callback, HCI_Isr unless an SPI transaction
+ *         is in progress.
+ * @note   The EIC handler of the core is shared by all the lines and
+ *         dispatches on INTFLAG, not on INTENSET: an edge of another line
+ *         runs this callback even while Disable_SPI_IRQ masks it. The
+ *         flag is cleared by then, Enable_SPI_IRQ picks the data up.
+ * @param  None
+ * @retval None
+ */
+#if defined(ARDUINO_ARCH_SAMD)
+static void BNRG_SPI_EXTI_Isr(void)
+{
+  if(spi_irq_disabled > 0)
+    return;
+  HCI_Isr();
+}
+#endif
+
+/**
+ * @brief  Enable SPI IRQ, once every Disable_SPI_IRQ is matched.
+ * @note   An edge seen while disabled may have been consumed by the
+ *         shared EIC handler (see BNRG_SPI_EXTI_Isr), HCI_Isr runs here
+ *         if the line is still high. Nested in HCI_Isr, the call returns.
  * @param  None
  * @retval None
  */
 void Enable_SPI_IRQ(void)
 {
-  //HAL_NVIC_EnableIRQ(BNRG_SPI_EXTI_IRQn);  
+#if defined(ARDUINO_ARCH_SAMD)
+  if(spi_irq_disabled > 0 && --spi_irq_disabled == 0){
+    HAL_EXTI_BNRG_SPI_EXTI_PIN.set_interrupt(true);
+    if(BlueNRG_DataPresent())
+      HCI_Isr();
+  }
+#endif
 }
 
 /**
- * @brief  Disable SPI IRQ.
+ * @brief  Disable SPI IRQ, so that HCI_Isr cannot break into an SPI
+ *         transaction. Nests, e.g. HCI_Isr landing in between the
+ *         increment and the masking.
+ * @note   Masks the BlueNRG line in the EIC only, the other EIC lines and
+ *         interrupts stay enabled. The mask alone does not keep HCI_Isr
+ *         out, BNRG_SPI_EXTI_Isr checks the depth as well.
  * @param  None
  * @retval None
  */
 void Disable_SPI_IRQ(void)
 { 
-  //HAL_NVIC_DisableIRQ(BNRG_SPI_EXTI_IRQn);
+#if defined(ARDUINO_ARCH_SAMD)
+  if(spi_irq_disabled++ == 0)
+    HAL_EXTI_BNRG_SPI_EXTI_PIN.set_interrupt(false);
+#endif
 }
 
 /**
@@ -428,6 +608,182 @@ static  uint8_t SPI_I2S_ReceiveData(SPI_HandleTypeDef *hspi)
   return 0;//hspi->Instance->DR;
 }
 
+#if defined(ARDUINO_ARCH_SAMD) && BNRG_SPI_DMA
+/**
+ * @brief  Sets up the DMAC for the SPI transfers, unless it is in use
+ *         already (the SPI transfers stay on the CPU then).
+ * @param  None
+ * @retval None
+ */
+static void SPI_DMA_Init(void)
+{
+  uint8_t ch;
+  
+  if(DMAC->CTRL.bit.DMAENABLE)
+    return;
+  
+  /* NOTE the DMAC AHB/APB clocks are on after reset */
+  DMAC->CTRL.reg = DMAC_CTRL_SWRST;
+  while(DMAC->CTRL.bit.SWRST);
+  
+  DMAC->BASEADDR.reg = (uint32_t)dma_desc;
+  DMAC->WRBADDR.reg = (uint32_t)dma_wb;
+  DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+  
+  for(ch = 0; ch < DMA_CH_NUM; ch++){
+    DMAC->CHID.reg = DMAC_CHID_ID(ch);
+    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0)
+      | DMAC_CHCTRLB_TRIGSRC(ch == DMA_CH_RX ? BNRG_SPI_DMAC_ID_RX : BNRG_SPI_DMAC_ID_TX)
+      | DMAC_CHCTRLB_TRIGACT_BEAT;
+  }
+  
+  /* completion and errors are polled in INTSTATUS, the interrupt stays
+     disabled in the NVIC */
+  DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_RX);
+  DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR;
+  
+  dma_ok = 1;
+}
+
+/**
+ * @brief  Stops both channels, after a transfer error or timeout.
+ * @param  None
+ * @retval None
+ */
+static void SPI_DMA_Abort(void)
+{
+  uint8_t ch;
+  
+  for(ch = 0; ch < DMA_CH_NUM; ch++){
+    DMAC->CHID.reg = DMAC_CHID_ID(ch);
+    DMAC->CHCTRLA.reg = 0;
+    while(DMAC->CHCTRLA.bit.ENABLE);
+    DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_MASK;
+  }
+}
+
+/**
+ * @brief  Transmits and receives a block by the DMAC, one channel per
+ *         direction, idling until the last byte is received.
+ * @note   On a transfer error or timeout the channels are stopped and the
+ *         DMAC left alone from then on, the block is lost (the HCI layer
+ *         drops the malformed packet, a command times out).
+ * @param  pTxData: bytes to send, NULL for dummy bytes
+ * @param  pRxData: buffer for the received bytes, NULL to drop them
+ * @param  Size: amount of data
+ * @retval None
+ */
+static void SPI_DMA_Transfer(const uint8_t *pTxData, uint8_t *pRxData, uint8_t Size)
+{
+  DmacDescriptor *rx = &dma_desc[DMA_CH_RX];
+  DmacDescriptor *tx = &dma_desc[DMA_CH_TX];
+  uint32_t scr;
+  uint8_t flags, n_ms, idle;
+  
+  /* NOTE with increment the address is the end of the block */
+  rx->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE
+    | (pRxData != NULL ? DMAC_BTCTRL_DSTINC : 0);
+  rx->BTCNT.reg = Size;
+  rx->SRCADDR.reg = (uint32_t)&BNRG_SPI_SERCOM->SPI.DATA.reg;
+  rx->DSTADDR.reg = pRxData != NULL ? (uint32_t)(pRxData + Size) : (uint32_t)&dma_rx_dummy;
+  rx->DESCADDR.reg = 0;
+  
+  tx->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE
+    | (pTxData != NULL ? DMAC_BTCTRL_SRCINC : 0);
+  tx->BTCNT.reg = Size;
+  tx->SRCADDR.reg = pTxData != NULL ? (uint32_t)(pTxData + Size) : (uint32_t)&dma_tx_dummy;
+  tx->DSTADDR.reg = (uint32_t)&BNRG_SPI_SERCOM->SPI.DATA.reg;
+  tx->DESCADDR.reg = 0;
+  
+  __DSB();
+  
+  /* receiver first, no byte may be missed */
+  DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_RX);
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+  DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_TX);
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+  
+  /* idle with the bus clocks on until the receiver is done or failed:
+     SEVONPEND wakes WFE when the DMAC interrupt turns pending, disabled
+     or not, the SysTick interrupt every 1 ms for the timeout.
+     NOTE HCI_Isr runs above the SysTick priority, HAL_GetTick stands
+     still and a SysTick left pending wakes WFE once: the timeout counts
+     the counter wraps (COUNTFLAG, cleared on read) and the wait spins
+     in handler mode */
+  idle = __get_IPSR() == 0;
+  n_ms = 0;
+  (void)SysTick->CTRL;
+  scr = SCB->SCR;
+  SCB->SCR = (scr & ~SCB_SCR_SLEEPDEEP_Msk) | SCB_SCR_SEVONPEND_Msk;
+  PM->SLEEP.reg = PM_SLEEP_IDLE(PM_SLEEP_IDLE_CPU_Val);
+  while(!(DMAC->INTSTATUS.reg & (1ul << DMA_CH_RX)) && n_ms <= DMA_TIMEOUT_MS){
+    if(idle)
+      __WFE();
+    if(SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk)
+      n_ms++;
+  }
+  SCB->SCR = scr;
+  
+  DMAC->CHID.reg = DMAC_CHID_ID(DMA_CH_RX);
+  flags = DMAC->CHINTFLAG.reg;
+  DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL | DMAC_CHINTFLAG_TERR;
+  NVIC_ClearPendingIRQ(DMAC_IRQn);
+  
+  if(!(flags & DMAC_CHINTFLAG_TCMPL) || (flags & DMAC_CHINTFLAG_TERR)){
+    SPI_DMA_Abort();
+    dma_ok = 0;
+  }
+}
+#endif
+
+/**
+ * @brief  Transmits and receives a block, by the DMAC if available and
+ *         worth it, by the CPU otherwise.
+ * @param  pTxData: bytes to send, NULL for dummy bytes (0xFF)
+ * @param  pRxData: buffer for the received bytes, NULL to drop them
+ * @param  Size: amount of data
+ * @retval None
+ */
+static void SPI_Transfer(const uint8_t *pTxData, uint8_t *pRxData, uint8_t Size)
+{
+#if defined(ARDUINO_ARCH_SAMD)
+  SercomSpi *spi = &BNRG_SPI_SERCOM->SPI;
+  uint8_t n_tx = 0, n_rx = 0;
+  uint8_t b;
+  
+#if BNRG_SPI_DMA
+  if(dma_ok && Size >= BNRG_SPI_DMA_MIN){
+    SPI_DMA_Transfer(pTxData, pRxData, Size);
+    return;
+  }
+#endif
+  
+  /* NOTE DATA is double buffered both ways: at most 2 bytes in flight
+     keep the transmitter busy without overflowing the receiver */
+  while(n_rx < Size){
+    if(n_tx < Size && (uint8_t)(n_tx - n_rx) < 2 && spi->INTFLAG.bit.DRE){
+      spi->DATA.reg = pTxData != NULL ? pTxData[n_tx] : 0xFF;
+      n_tx++;
+    }
+    if(spi->INTFLAG.bit.RXC){
+      b = spi->DATA.reg;
+      if(pRxData != NULL)
+        pRxData[n_rx] = b;
+      n_rx++;
+    }
+  }
+#else
+  uint8_t i;
+  uint8_t b;
+  
+  for (i = 0; i < Size; i++) {
+    b = BLESPI->transfer(pTxData != NULL ? pTxData[i] : 0xFF);
+    if (pRxData != NULL)
+      pRxData[i] = b;
+  }
+#endif
+}
+
 /**
   * @brief  Transmit and Receive an amount of data in blocking mode 
   * @param  hspi: pointer to a SPI_HandleTypeDef structure that contains
@@ -439,10 +795,7 @@ static  uint8_t SPI_I2S_ReceiveData(SPI_HandleTypeDef *hspi)
   */
 void HAL_SPI_TransmitReceive_Opt(const uint8_t *pTxData, uint8_t *pRxData, uint8_t Size)
 {
-  uint8_t i;
-  for (i = 0; i < Size; i++) {
-    *pRxData++ = BLESPI->transfer(*pTxData++);
-  }
+  SPI_Transfer(pTxData, pRxData, Size);
 }
 
 /**
@@ -455,11 +808,7 @@ void HAL_SPI_TransmitReceive_Opt(const uint8_t *pTxData, uint8_t *pRxData, uint8
   */
 void HAL_SPI_Transmit_Opt(const uint8_t *pTxData, uint8_t Size)
 {
-  uint8_t i;
-  
-  for (i = 0; i < Size; i++) {
-    BLESPI->transfer(*pTxData++);
-  }
+  SPI_Transfer(pTxData, NULL, Size);
 }
 
 /**
@@ -472,11 +821,7 @@ void HAL_SPI_Transmit_Opt(const uint8_t *pTxData, uint8_t Size)
   */
 void HAL_SPI_Receive_Opt(uint8_t *pRxData, uint8_t Size)
 {
-  uint8_t i;
-  
-  for (i = 0; i < Size; i++) {
-    *pRxData++ = BLESPI->transfer(0xFF);
-  }
+  SPI_Transfer(NULL, pRxData, Size);
 }
 
 #ifdef __cplusplus
@@ -48,9 +48,35 @@
 extern "C" {
 #endif 
 
+#include "STBlueNRG/hal.h"
+
 #define SYSCLK_FREQ 80000000
 #define SPI_HandleTypeDef uint8_t*
 
+/* SPI clock, the BlueNRG-MS accepts up to 8 MHz */
+#ifndef BNRG_SPI_CLOCK_HZ
+#define BNRG_SPI_CLOCK_HZ 8000000
+#endif
+
+#if defined(ARDUINO_ARCH_SAMD)
+/* SERCOM behind BLESPI, see PERIPH_SPI in variant.h */
+#ifndef BNRG_SPI_SERCOM
+#define BNRG_SPI_SERCOM SERCOM4
+#define BNRG_SPI_DMAC_ID_RX SERCOM4_DMAC_ID_RX
+#define BNRG_SPI_DMAC_ID_TX SERCOM4_DMAC_ID_TX
+#endif
+
+/* block transfers by the DMAC, 0 for the CPU loop only */
+#ifndef BNRG_SPI_DMA
+#define BNRG_SPI_DMA 1
+#endif
+
+/* shorter transfers (e.g. the 5 byte SPI header) are cheaper on the CPU */
+#ifndef BNRG_SPI_DMA_MIN
+#define BNRG_SPI_DMA_MIN 16
+#endif
+#endif
+
 
 void BNRG_SPI_Init(void);
 void BlueNRG_RST(void);
@@ -62,6 +88,9 @@ int32_t BlueNRG_SPI_Write(uint8_t* data1,
                           uint8_t* data2,
                           uint8_t Nb_bytes1,
                           uint8_t Nb_bytes2);
+int32_t BlueNRG_SPI_Writev(const tHalIovec *iov,
+                           uint8_t iovcnt,
+                           uint8_t min_bytes);
 
 void Hal_Write_Serial(const void* data1, const void* data2, int32_t n_bytes1, int32_t n_bytes2);
 void HAL_SPI_TransmitReceive_Opt(const uint8_t *pTxData, uint8_t *pRxData, uint8_t Size);
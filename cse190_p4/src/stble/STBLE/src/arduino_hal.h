@@ -13,13 +13,34 @@
 
 #define HAL_Delay(x) delay(x)
 
+#if defined(__cplusplus) && defined(ARDUINO_ARCH_SAMD)
+/* Fast path: BNRG pins resolved at compile time, single-cycle PORT IOBUS access.
+   The pin descriptors are the SAMD21 ones of the sketch, other targets (and the
+   C sources) go through digitalWrite/digitalRead. */
+#include "../../../../port.h"
+
+#define HAL_GPIO_PIN_BNRG_SPI_CS_PIN tinyzero::port::pins::D10_PA18
+#define HAL_GPIO_PIN_BNRG_SPI_EXTI_PIN tinyzero::port::pins::D2_PA14
+#define HAL_GPIO_PIN_BNRG_SPI_RESET_PIN tinyzero::port::pins::D9_PA07
+
+/* EIC line of BNRG_SPI_EXTI_PIN */
+#define HAL_EXTI_BNRG_SPI_EXTI_PIN tinyzero::port::extints::D2_PA14_EXTINT14
+
+#define HAL_GPIO_WritePin(x, y, z) HAL_GPIO_PIN_##y.write((z) == GPIO_PIN_SET)
+
+#define HAL_GPIO_ReadPin(x,y) (HAL_GPIO_PIN_##y.read() ? GPIO_PIN_SET : GPIO_PIN_RESET)
+#else
 #define HAL_GPIO_WritePin(x, y, z) digitalWrite(y,z)
 
 #define HAL_GPIO_ReadPin(x,y) digitalRead(y)
+#endif
 
 #define HAL_GetTick millis
 
+/* NOTE CMSIS provides the real ones on Cortex-M */
+#if !defined(ARDUINO_ARCH_SAMD)
 #define __disable_irq() 0
 
 #define __set_PRIMASK(x) 0
 #define __get_PRIMASK() 0
+#endif
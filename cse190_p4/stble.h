@@ -23,39 +23,191 @@
 #include <cstring>
 #include <cstdint>
 #include <cstddef>
-
-#include <list>
+#include <limits>
 
 #include "src/stble/STBLE/src/STBLE.h"
+#include "aci.h"
 
 
-struct HCI_Event_CB_Info {
-	void *data; 
-	void (*cb)(void *, void *);
-};
-inline std::list<struct HCI_Event_CB_Info> HCI_Event_CBs;
-
-void HCI_Event_CB(void *pckt) {
-	for (auto info : ::HCI_Event_CBs)
-		info.cb(info.data, pckt);
-}
-
 namespace stble {
 
 inline bool process() {
 	// nothing to process
-	if (HCI_Queue_Empty())
+	// NOTE pending commands are expired and deferred ones written here
+	if (HCI_Queue_Empty() && HCI_Cmd_Pending() == 0 && HCI_Write_Pending() == 0)
 		return false;
 	HCI_Process();
 	return true;
 }
 
-inline void register_event(void (*cb)(void *, void *), void *data = nullptr) {
-	::HCI_Event_CBs.push_back(
-		(struct HCI_Event_CB_Info) { .data = data, .cb = cb }
+// HCI read packet ring statistics
+struct hci_stats_s : tHciStats {
+	operator std::string() const {
+		return std::string("")
+			+ "pool = " + std::to_string(this->max_in_use)
+				+ "/" + std::to_string(this->pool_size) + ", "
+			+ "received = " + std::to_string(this->n_received) + ", "
+			+ "stalled = " + std::to_string(this->n_stalled) + ", "
+			+ "recycled = " + std::to_string(this->n_recycled) + ", "
+			+ "discarded = " + std::to_string(this->n_discarded) + ", "
+			+ "malformed = " + std::to_string(this->n_verify_type + this->n_verify_len) + ", "
+			+ "async = " + std::to_string(this->n_cmd_async) + ", "
+			+ "timeout = " + std::to_string(this->n_cmd_timeout) + ", "
+			+ "deferred = " + std::to_string(this->n_cmd_deferred) + ", "
+			+ "dropped = " + std::to_string(this->n_write_dropped) + ", "
+			+ "uncredited = " + std::to_string(this->n_credit_timeout);
+	}
+};
+
+inline struct hci_stats_s hci_stats() {
+	struct hci_stats_s stats;
+	HCI_Get_Stats(&stats);
+	return stats;
+}
+
+// asynchronous commands
+// the command is sent right away, or from `process` while the BlueNRG wakes up,
+//	the completion is matched in `process` (see `hci_send_req_cb`)
+//	so the caller may go back to sleep meanwhile
+struct async_stats_s {
+	uint32_t n_failed = 0;
+	uint16_t last_opcode = 0;
+	uint8_t last_status = BLE_STATUS_SUCCESS;
+
+	operator std::string() const {
+		return std::string("")
+			+ "failed = " + std::to_string(this->n_failed) + ", "
+			+ "last = " + std::to_string(this->last_opcode)
+				+ ":" + std::to_string(this->last_status);
+	}
+};
+
+inline struct async_stats_s async_stats;
+
+// failures are only counted, the caller is not waiting anymore
+inline void on_async_complete(uint8_t status, const uint8_t *, uint8_t, void *data) {
+	if (status == BLE_STATUS_SUCCESS)
+		return;
+	async_stats.n_failed += 1;
+	async_stats.last_opcode = (uint16_t)(uintptr_t)data;
+	async_stats.last_status = status;
+}
+
+// `cmd` is an `aci` command descriptor, e.g. `aci::gap_terminate`
+template <typename cmd, typename... parts_t>
+inline tBleStatus send_async(const parts_t &...parts) {
+	return cmd::send_async(
+		on_async_complete, (void *)(uintptr_t)cmd::opcode, 
+		parts...
 	);
 }
 
+// HCI event dispatch
+// a packet is decoded once and handed to the subscribers of its
+//	(event, LE meta subevent or vendor ecode) key only
+class hci_dispatcher {
+public:
+	static const constexpr std::size_t cap = 8;
+
+	// NOTE `sub` is unused (0) for events other than LE meta and vendor events
+	struct key_s {
+		uint8_t evt;
+		uint16_t sub;
+
+		constexpr bool operator==(const struct key_s &rhs) const {
+			return this->evt == rhs.evt && this->sub == rhs.sub;
+		}
+	};
+
+protected:
+	using fn_t = void ();
+	using invoke_fn_t = void (fn_t *, void *, const void *);
+
+	struct entry_s {
+		struct key_s key;
+		invoke_fn_t *invoke;
+		fn_t *fn;
+		void *data;
+	};
+
+	struct entry_s entries[cap];
+	std::size_t n_entries = 0;
+
+	// restores the handler type erased by `subscribe`
+	template <typename evt_type>
+	static void invoke(fn_t *fn, void *data, const void *payload) {
+		((void (*)(void *, const evt_type &))fn)(data, *(const evt_type *)payload);
+	}
+
+	static bool decode(const void *pckt, struct key_s &key, const void *&payload) {
+		auto *hci_pckt = (const hci_uart_pckt *)pckt;
+		if (hci_pckt->type != HCI_EVENT_PKT)
+			return false;
+
+		auto *event_pckt = (const hci_event_pckt *)hci_pckt->data;
+		key = { .evt = event_pckt->evt, .sub = 0 };
+		payload = event_pckt->data;
+
+		switch (event_pckt->evt) {
+		case EVT_LE_META_EVENT: {
+			auto *evt = (const evt_le_meta_event *)event_pckt->data;
+			key.sub = evt->subevent;
+			payload = evt->data;
+		} break;
+		case EVT_VENDOR: {
+			auto *evt = (const evt_blue_aci *)event_pckt->data;
+			key.sub = evt->ecode;
+			payload = evt->data;
+		} break;
+		}
+		return true;
+	}
+
+public:
+	hci_dispatcher() {}
+
+	// `evt_type` is the payload behind the key, e.g. `evt_le_connection_complete`
+	// NOTE false if the table is full
+	template <typename evt_type>
+	bool subscribe(
+		uint8_t evt, uint16_t sub,
+		void (*fn)(void *, const evt_type &), void *data = nullptr
+	) {
+		if (this->n_entries >= cap)
+			return false;
+		this->entries[this->n_entries++] = (struct entry_s) {
+			.key = { .evt = evt, .sub = sub },
+			.invoke = &invoke<evt_type>,
+			.fn = (fn_t *)fn,
+			.data = data
+		};
+		return true;
+	}
+
+	void dispatch(const void *pckt) {
+		struct key_s key;
+		const void *payload;
+		if (!decode(pckt, key, payload))
+			return;
+
+		for (std::size_t i = 0; i < this->n_entries; i++) {
+			const auto &e = this->entries[i];
+			if (e.key == key)
+				e.invoke(e.fn, e.data, payload);
+		}
+	}
+};
+
+inline hci_dispatcher hci_events;
+}
+
+// called by `HCI_Process` for every queued event
+void HCI_Event_CB(void *pckt) {
+	stble::hci_events.dispatch(pckt);
+}
+
+namespace stble {
+
 struct public_address {
 	tBDAddr addr;
 
@@ -144,9 +296,9 @@ protected:
 	} handle;
 
 	status_e set_pub_address(const struct public_address &addr) {
-		if (aci_hal_write_config_data(
-			CONFIG_DATA_PUBADDR_OFFSET, 
-			sizeof(addr), (const uint8_t *)&addr
+		if (aci::hal_write_config_data::send(
+			{ .offset = CONFIG_DATA_PUBADDR_OFFSET, .len = sizeof(addr) }, 
+			{ .data = &addr, .len = sizeof(addr) }
 		) != BLE_STATUS_SUCCESS)
 			return status_e::STATUS_FAILURE;
 		return status_e::STATUS_SUCCESS;
@@ -156,6 +308,7 @@ public:
 	status_e init(const struct ble_info &info) {
 		status_e s = status_e::STATUS_SUCCESS;
 		tBleStatus s_ble;
+		gap_init_rp gap_rp;
 
 		// init HCI
 		HCI_Init();
@@ -170,35 +323,42 @@ public:
 		}
 
 		// init gatt
-		s_ble = aci_gatt_init();
+		s_ble = aci::gatt_init::send();
 		if (s_ble != BLE_STATUS_SUCCESS) {
 			s = status_e::STATUS_FAILURE;
 			goto _loc_finally;
 		}
 
 		// init gap
-		s_ble = aci_gap_init_IDB05A1(
-			GAP_PERIPHERAL_ROLE_IDB05A1, 
-			0, 
-			7, 
-			&this->handle.serv, 
-			&this->handle.dev_name_char, 
-			&this->handle.appear_char
-		);
+		s_ble = aci::gap_init::send(gap_rp, {
+			.role = GAP_PERIPHERAL_ROLE_IDB05A1, 
+			.privacy_enabled = 0, 
+			.device_name_char_len = 7
+		});
 		if (s_ble != BLE_STATUS_SUCCESS) {
 			s = status_e::STATUS_FAILURE;
 			goto _loc_finally;
 		}
+		this->handle.serv = gap_rp.service_handle;
+		this->handle.dev_name_char = gap_rp.dev_name_char_handle;
+		this->handle.appear_char = gap_rp.appearance_char_handle;
 
 	_loc_finally:
 		return s;
 	}
 
+	// NOTE the value length is a single byte
 	status_e set_dev_name(const char *name, std::size_t len) {
-		if (aci_gatt_update_char_value(
-			this->handle.serv, this->handle.dev_name_char, 
-			0, 
-			len, name
+		if (len > std::numeric_limits<uint8_t>::max())
+			return status_e::STATUS_FAILURE;
+		if (aci::gatt_update_char_value::send(
+			{
+				.service_handle = this->handle.serv, 
+				.char_handle = this->handle.dev_name_char, 
+				.val_offset = 0, 
+				.val_len = (uint8_t)len
+			},
+			{ .data = name, .len = (uint8_t)len }
 		) != BLE_STATUS_SUCCESS)
 			return status_e::STATUS_FAILURE;
 		return status_e::STATUS_SUCCESS;
@@ -216,8 +376,10 @@ public:
 	// see https://www.st.com/resource/en/user_manual/um1865-the-bluenrgms-bluetooth-le-stack-application-command-interface-aci-stmicroelectronics.pdf
 	// Table 292. Tx_power_level command parameters combination
 	status_e set_txpower(bool high, uint8_t level_dbm) {
-		if (aci_hal_set_tx_power_level(high, level_dbm) 
-			!= BLE_STATUS_SUCCESS) 
+		if (aci::hal_set_tx_power_level::send({
+			.en_high_power = high, 
+			.pa_level = level_dbm
+		}) != BLE_STATUS_SUCCESS) 
 			return status_e::STATUS_FAILURE;
 		return status_e::STATUS_SUCCESS;
 	}
@@ -230,17 +392,25 @@ public:
 	) {
 		tBleStatus s_ble;
 
-		s_ble = hci_le_set_scan_resp_data(0, nullptr);
+		// no scan response data
+		s_ble = aci::le_set_scan_resp_data::send({ .length = 0, .data = {} });
 		if (s_ble != BLE_STATUS_SUCCESS)
 			return status_e::STATUS_FAILURE;
 
-		s_ble = aci_gap_set_discoverable(
-			ADV_IND,
-			(intvl_min_ms * 1000) / 625, (intvl_max_ms * 1000) / 625,
-			PUBLIC_ADDR, NO_WHITE_LIST_USE,
-			name.size(), (const char *)&name, 
-			0, nullptr, 
-			0, 0
+		s_ble = aci::gap_set_discoverable::send(
+			{
+				.adv_type = ADV_IND,
+				.adv_intvl_min = (uint16_t)((intvl_min_ms * 1000) / 625), 
+				.adv_intvl_max = (uint16_t)((intvl_max_ms * 1000) / 625),
+				.own_addr_type = PUBLIC_ADDR, 
+				.adv_filter_policy = NO_WHITE_LIST_USE,
+				.local_name_len = (uint8_t)name.size()
+			},
+			{ .data = &name, .len = (uint8_t)name.size() },
+			// no service UUIDs
+			{ .len = 0 }, { .data = nullptr, .len = 0 },
+			// no slave connection interval preference
+			{ .min = 0, .max = 0 }
 		);
 		if (s_ble != BLE_STATUS_SUCCESS)
 			return status_e::STATUS_FAILURE;
@@ -249,7 +419,15 @@ public:
 	}
 
 	status_e unset_discoverable() {
-		if (aci_gap_set_non_discoverable() != BLE_STATUS_SUCCESS)
+		if (aci::gap_set_non_discoverable::send() != BLE_STATUS_SUCCESS)
+			return status_e::STATUS_FAILURE;
+		return status_e::STATUS_SUCCESS;
+	}
+
+	// NOTE completes in `process`, see `send_async`
+	status_e unset_discoverable_async() {
+		if (send_async<aci::gap_set_non_discoverable>() 
+			!= BLE_STATUS_SUCCESS)
 			return status_e::STATUS_FAILURE;
 		return status_e::STATUS_SUCCESS;
 	}
@@ -280,57 +458,75 @@ public:
 
 		status_e s = status_e::STATUS_SUCCESS;
 		tBleStatus s_ble;
+		gatt_add_serv_rp serv_rp;
+		gatt_add_char_rp char_rp;
 
 		// add service handle
-		s_ble = aci_gatt_add_serv(
-			uuid_type, uuid_uart_service, 
-			PRIMARY_SERVICE, 7, 
-			&info.handle.serv
+		s_ble = aci::gatt_add_serv::send(
+			serv_rp,
+			{ .uuid_type = uuid_type }, 
+			aci::uuid(uuid_type, uuid_uart_service), 
+			{ .serv_type = PRIMARY_SERVICE, .max_attr_records = 7 }
 		);
 		if (s_ble != BLE_STATUS_SUCCESS) {
 			s = status_e::STATUS_FAILURE;
 			goto _loc_finally;
 		}
+		info.handle.serv = serv_rp.handle;
 
 		// add tx/rx handle
-		s_ble = aci_gatt_add_char(
-			info.handle.serv, 
-			uuid_type, uuid_tx_char, 
-			20, 
-			CHAR_PROP_WRITE_WITHOUT_RESP, 
-			ATTR_PERMISSION_NONE, 
-			GATT_NOTIFY_ATTRIBUTE_WRITE,
-			16, 
-			1, 
-			&info.handle.tx
+		s_ble = aci::gatt_add_char::send(
+			char_rp,
+			{ .serv_handle = info.handle.serv, .uuid_type = uuid_type }, 
+			aci::uuid(uuid_type, uuid_tx_char), 
+			{
+				.value_len = 20, 
+				.props = CHAR_PROP_WRITE_WITHOUT_RESP, 
+				.sec_perms = ATTR_PERMISSION_NONE, 
+				.evt_mask = GATT_NOTIFY_ATTRIBUTE_WRITE,
+				.enc_key_size = 16, 
+				.is_variable = 1
+			}
 		);
 		if (s_ble != BLE_STATUS_SUCCESS) {
 			s = status_e::STATUS_FAILURE;
 			goto _loc_finally;
 		}
-
-		s_ble = aci_gatt_add_char(
-			info.handle.serv, 
-			uuid_type, uuid_rx_char, 
-			20, 
-			CHAR_PROP_NOTIFY, 
-			ATTR_PERMISSION_NONE, 
-			GATT_DONT_NOTIFY_EVENTS,
-			16, 
-			1, 
-			&info.handle.rx
+		info.handle.tx = char_rp.handle;
+
+		s_ble = aci::gatt_add_char::send(
+			char_rp,
+			{ .serv_handle = info.handle.serv, .uuid_type = uuid_type }, 
+			aci::uuid(uuid_type, uuid_rx_char), 
+			{
+				.value_len = 20, 
+				.props = CHAR_PROP_NOTIFY, 
+				.sec_perms = ATTR_PERMISSION_NONE, 
+				.evt_mask = GATT_DONT_NOTIFY_EVENTS,
+				.enc_key_size = 16, 
+				.is_variable = 1
+			}
 		);
 		if (s_ble != BLE_STATUS_SUCCESS) {
 			s = status_e::STATUS_FAILURE;
 			goto _loc_finally;
 		}
+		info.handle.rx = char_rp.handle;
 
 	_loc_finally:
 		return std::make_pair(s, info);
 	}
 
 	status_e standby() {
-		if (aci_hal_device_standby() != BLE_STATUS_SUCCESS)
+		if (aci::hal_device_standby::send() != BLE_STATUS_SUCCESS)
+			return status_e::STATUS_FAILURE;
+		return status_e::STATUS_SUCCESS;
+	}
+
+	// NOTE completes in `process`, see `send_async`
+	status_e standby_async() {
+		if (send_async<aci::hal_device_standby>() 
+			!= BLE_STATUS_SUCCESS)
 			return status_e::STATUS_FAILURE;
 		return status_e::STATUS_SUCCESS;
 	}
@@ -344,81 +540,71 @@ protected:
 		uint16_t conn = 0;
 	} handle;
 
-	static void hci_handler(void *data, void *pckt) {
+	static void on_disconn_complete(void *data, const evt_disconn_complete &evt) {
 		auto *this_ = (class uart *)data;
+		if (this_->handle.conn == 0)
+			return;
+		// TODO multiple connections??
+		if (this_->handle.conn != evt.handle)
+			return;
 
-		auto *hci_pckt = (hci_uart_pckt *)pckt;
-		if (hci_pckt->type != HCI_EVENT_PKT)
+		if (this_->callbacks.disconnect != nullptr)
+			this_->callbacks.disconnect(evt);
+	}
+
+	static void on_conn_complete(void *data, const evt_le_connection_complete &cc) {
+		auto *this_ = (class uart *)data;
+
+		// TODO cc->peer_bdaddr_type;
+		this_->handle.conn = cc.handle;
+		if (this_->callbacks.connect != nullptr)
+			this_->callbacks.connect(cc);
+	}
+
+	static void on_read_permit_req(void *data, const evt_gatt_read_permit_req &pr) {
+		auto *this_ = (class uart *)data;
+		if (this_->handle.conn == 0)
+			return;
+		// TODO multiple connections??
+		if (this_->handle.conn != pr.conn_handle)
 			return;
 
-		auto *event_pckt = (hci_event_pckt*)hci_pckt->data;
-		switch (event_pckt->evt) {
-		case EVT_DISCONN_COMPLETE: {
-			auto *evt = (evt_disconn_complete *)event_pckt->data;
-			if (this_->handle.conn == 0)
-				break;
-			// TODO multiple connections??
-			if (this_->handle.conn != evt->handle)
-				break;
-
-			if (this_->callbacks.disconnect != nullptr)
-				this_->callbacks.disconnect(*evt);
-		} break;
-		case EVT_LE_META_EVENT: {
-			auto *evt = (evt_le_meta_event *)event_pckt->data;
+		// TODO err handling
+		aci::gatt_allow_read::send({ .conn_handle = pr.conn_handle });
+	}
 
-			switch (evt->subevent) {
-			case EVT_LE_CONN_COMPLETE: {
-				auto *cc = (evt_le_connection_complete *)evt->data;
+	static void on_attr_modified(void *data, const evt_gatt_attr_modified_IDB05A1 &evt) {
+		auto *this_ = (class uart *)data;
+		if (this_->handle.conn == 0)
+			return;
+		if (this_->handle.conn != evt.conn_handle)
+			return;
 
-				// TODO cc->peer_bdaddr_type;
-				this_->handle.conn = cc->handle;
-				if (this_->callbacks.connect != nullptr)
-					this_->callbacks.connect(*cc);
-			} break;
-			}
-		} break;
-		case EVT_VENDOR: {
-			auto *blue_evt = (evt_blue_aci *)event_pckt->data;
-
-			switch (blue_evt->ecode) {
-			case EVT_BLUE_GATT_READ_PERMIT_REQ: {
-				auto *pr = (evt_gatt_read_permit_req *)blue_evt->data;
-				if (this_->handle.conn == 0)
-					break;
-				// TODO multiple connections??
-				if (this_->handle.conn != pr->conn_handle)
-					break;
-
-				// TODO err handling
-				aci_gatt_allow_read(pr->conn_handle);
-			} break;
-			case EVT_BLUE_GATT_ATTRIBUTE_MODIFIED: {
-				auto *evt = (evt_gatt_attr_modified_IDB05A1 *)blue_evt->data;
-				if (this_->handle.conn == 0)
-					break;
-				if (this_->handle.conn != evt->conn_handle)
-					break;
-
-				// ready for read
-				if (evt->attr_handle == this_->info.handle.tx + 1) {
-					if (this_->callbacks.read != nullptr)
-						this_->callbacks.read(
-							(const char *)evt->att_data, 
-							evt->data_length
-						);
-				}
-
-				// ready for write
-				if (evt->attr_handle == this_->info.handle.rx + 1) {
-					// TODO implement this
-				}
-			} break;
-			}
-		} break;
+		// ready for read
+		if (evt.attr_handle == this_->info.handle.tx + 1) {
+			if (this_->callbacks.read != nullptr)
+				this_->callbacks.read(
+					(const char *)evt.att_data, 
+					evt.data_length
+				);
+		}
+
+		// ready for write
+		if (evt.attr_handle == this_->info.handle.rx + 1) {
+			// TODO implement this
 		}
 	}
 
+	static void on_write_complete(
+		uint8_t status, const uint8_t *, uint8_t, void *data
+	) {
+		auto *this_ = (class uart *)data;
+		if (status == BLE_STATUS_SUCCESS)
+			return;
+		if (this_->callbacks.write_failed != nullptr)
+			this_->callbacks.write_failed(status);
+	}
+
 public:
 	struct {
 		void (*connect)(const evt_le_connection_complete &) = nullptr;
@@ -426,6 +612,8 @@ public:
 
 		void (*read)(const char *, std::size_t) = nullptr;
 		//void (*write)() = nullptr;
+		// asynchronous writes, called from `process`
+		void (*write_failed)(tBleStatus) = nullptr;
 	} callbacks;
 
 	enum status_e {
@@ -437,30 +625,71 @@ public:
 	status_e init(const struct uart_info &info) {
 		this->info = info;
 
-		// register event handler
-		register_event(this->hci_handler, this);
+		// register event handlers
+		auto &ev = hci_events;
+		ev.subscribe(EVT_DISCONN_COMPLETE, 0, on_disconn_complete, this);
+		ev.subscribe(EVT_LE_META_EVENT, EVT_LE_CONN_COMPLETE, on_conn_complete, this);
+		ev.subscribe(EVT_VENDOR, EVT_BLUE_GATT_READ_PERMIT_REQ, on_read_permit_req, this);
+		ev.subscribe(EVT_VENDOR, EVT_BLUE_GATT_ATTRIBUTE_MODIFIED, on_attr_modified, this);
 
 		return status_e::STATUS_SUCCESS;
 	}
 
-	// TODO async write??
+	// NOTE characteristic value length, see ble::add_service_uart
+	static const constexpr std::size_t value_len_max = 20;
+
+	// NOTE longer messages are split into consecutive notifications
 	status_e write(const char *data, std::size_t len) {
 		tBleStatus s_ble;
 
-		// TODO check if connected
-		/*s_ble = aci_gatt_write_charac_value(
-			this->info.handle.serv, 
-			this->info.handle.rx, 
-			len, (uint8_t *)data
-		);*/
-		s_ble = aci_gatt_update_char_value(
-			this->info.handle.serv, 
-			this->info.handle.rx, 
-			0, 
-			len, data
-		);
-		if (s_ble != BLE_STATUS_SUCCESS) 
-			return status_e::STATUS_FAILURE;
+		for (std::size_t off = 0; off < len; off += value_len_max) {
+			// TODO check if connected
+			/*s_ble = aci_gatt_write_charac_value(
+				this->info.handle.serv, 
+				this->info.handle.rx, 
+				len, (uint8_t *)data
+			);*/
+			uint8_t n = std::min(len - off, value_len_max);
+			s_ble = aci::gatt_update_char_value::send(
+				{
+					.service_handle = this->info.handle.serv, 
+					.char_handle = this->info.handle.rx, 
+					.val_offset = 0, 
+					.val_len = n
+				},
+				{ .data = data + off, .len = n }
+			);
+			if (s_ble != BLE_STATUS_SUCCESS) 
+				return status_e::STATUS_FAILURE;
+		}
+
+		return status_e::STATUS_SUCCESS;
+	}
+
+	// as `write`, without waiting for the controller
+	// NOTE `data` is copied out before returning,
+	//	failures are reported later through `callbacks.write_failed`
+	// NOTE falls back to a blocking update if too many commands are pending
+	status_e write_async(const char *data, std::size_t len) {
+		tBleStatus s_ble;
+
+		for (std::size_t off = 0; off < len; off += value_len_max) {
+			uint8_t n = std::min(len - off, value_len_max);
+			const gatt_upd_char_val_cp cp = {
+				.service_handle = this->info.handle.serv, 
+				.char_handle = this->info.handle.rx, 
+				.val_offset = 0, 
+				.val_len = n
+			};
+			const struct aci::bytes_s val = { .data = data + off, .len = n };
+			s_ble = aci::gatt_update_char_value::send_async(
+				on_write_complete, this, cp, val
+			);
+			if (s_ble == BLE_STATUS_INSUFFICIENT_RESOURCES)
+				s_ble = aci::gatt_update_char_value::send(cp, val);
+			if (s_ble != BLE_STATUS_SUCCESS) 
+				return status_e::STATUS_FAILURE;
+		}
 
 		return status_e::STATUS_SUCCESS;
 	}
@@ -473,11 +702,29 @@ public:
 		return this->write(s.c_str(), s.length() + 1);
 	}
 
+	status_e print_async(const char *s) {
+		return this->write_async(s, strlen(s) + 1);
+	}
+
+	status_e print_async(const std::string &s) {
+		return this->write_async(s.c_str(), s.length() + 1);
+	}
+
 	status_e close() {
-		if (aci_gap_terminate(
-			this->handle.conn, 
-			HCI_OE_USER_ENDED_CONNECTION
-		) != BLE_STATUS_SUCCESS)
+		if (aci::gap_terminate::send({
+			.handle = this->handle.conn,
+			.reason = HCI_OE_USER_ENDED_CONNECTION
+		}) != BLE_STATUS_SUCCESS)
+			return status_e::STATUS_FAILURE;
+		return status_e::STATUS_SUCCESS;
+	}
+
+	// NOTE completes in `process`, see `send_async`
+	status_e close_async() {
+		if (send_async<aci::gap_terminate>(gap_terminate_cp{
+			.handle = this->handle.conn,
+			.reason = HCI_OE_USER_ENDED_CONNECTION
+		}) != BLE_STATUS_SUCCESS)
 			return status_e::STATUS_FAILURE;
 		return status_e::STATUS_SUCCESS;
 	}
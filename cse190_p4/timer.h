@@ -3,6 +3,7 @@
 #include <samd.h>
 
 #include "clock.h"
+#include "pm.h"
 #include "utils.h"
 
 
@@ -32,6 +33,14 @@ samd_define_tc_handler(
 	TC3, &TC3->COUNT16,
 	samd_tc_cb_TC3_mc0, samd_tc_cb_TC3_mc1
 );
+// TC4
+// NOTE TC5 is taken by arduino's `tone`
+inline samd_tc_callback_f *samd_tc_cb_TC4_mc0 = nullptr;
+inline samd_tc_callback_f *samd_tc_cb_TC4_mc1 = nullptr;
+samd_define_tc_handler(
+	TC4, &TC4->COUNT16,
+	samd_tc_cb_TC4_mc0, samd_tc_cb_TC4_mc1
+);
 
 
 // SAMD21 timer abstraction
@@ -44,6 +53,10 @@ struct timer_info {
 	enum clock::devid_e clkid;		// clock ID
 	IRQn_Type irqn;					// IRQ number
 	samd_tc_callback_f *&cb_ref;	// callback reference
+	uint8_t evgen_ovf;				// event generator ID: overflow/match
+	uint8_t evuser;					// event user ID
+	pm *pwr;						// power manager
+	enum pm::apbc_e apbcid;			// APB clock ID
 };
 
 class timer {
@@ -130,7 +143,7 @@ public:
 
 		this->clk = clk;
 
-		// TODO detach?
+		this->info.pwr->acquire(this->info.apbcid);
 		this->clk->attach(this->info.clkid);
 
 		// TODO 8 32 bit support
@@ -139,6 +152,13 @@ public:
 		return *this;
 	}
 
+	timer &deinit() {
+		this->disable();
+		this->clk->detach(this->info.clkid);
+		this->info.pwr->release(this->info.apbcid);
+		return *this;
+	}
+
 	// TODO
 	enum status_e {
 		STATUS_SUCCESS = 0,
@@ -169,6 +189,58 @@ public:
 		return *this;
 	}
 
+	// 30.6.4 Events: action taken on an incoming event
+	enum evact_e : uint16_t {
+		EVACT_OFF       = TC_EVCTRL_EVACT_OFF_Val,
+		EVACT_RETRIGGER = TC_EVCTRL_EVACT_RETRIGGER_Val,	// restart counting
+		EVACT_COUNT     = TC_EVCTRL_EVACT_COUNT_Val,		// count events
+		EVACT_START     = TC_EVCTRL_EVACT_START_Val,		// start on event
+		EVACT_PPW       = TC_EVCTRL_EVACT_PPW_Val,
+		EVACT_PWP       = TC_EVCTRL_EVACT_PWP_Val
+	};
+
+	// NOTE route an event to `event_user()` through `evsys::channel`
+	timer &set_event_input(enum evact_e act, bool invert = false) {
+		auto &evctrl = common_of(this->info.tc)->EVCTRL.bit;
+		evctrl.EVACT = act;
+		evctrl.TCINV = invert;
+		evctrl.TCEI = act != evact_e::EVACT_OFF;
+		return *this;
+	}
+
+	enum evout_e {
+		EVOUT_OVF,	// overflow/underflow, MC0 in MFRQ mode
+		EVOUT_MC0,
+		EVOUT_MC1
+	};
+
+	timer &set_event_output(enum evout_e ev, bool enable = true) {
+		auto &evctrl = common_of(this->info.tc)->EVCTRL.bit;
+		switch (ev) {
+		case evout_e::EVOUT_OVF: evctrl.OVFEO = enable; break;
+		case evout_e::EVOUT_MC0: evctrl.MCEO0 = enable; break;
+		case evout_e::EVOUT_MC1: evctrl.MCEO1 = enable; break;
+		}
+		return *this;
+	}
+
+	constexpr uint8_t event_user() const { return this->info.evuser; }
+
+	// event generator ID of `ev`, see `set_event_output`
+	// NOTE the MCx generators follow OVF on every TC
+	static_assert(
+		EVSYS_ID_GEN_TC3_MC_0 == EVSYS_ID_GEN_TC3_OVF + 1
+			&& EVSYS_ID_GEN_TC3_MC_1 == EVSYS_ID_GEN_TC3_OVF + 2,
+		"TC event generator IDs out of order"
+	);
+	constexpr uint8_t event_generator(enum evout_e ev = evout_e::EVOUT_OVF) const {
+		switch (ev) {
+		case evout_e::EVOUT_MC0: return this->info.evgen_ovf + 1;
+		case evout_e::EVOUT_MC1: return this->info.evgen_ovf + 2;
+		default: return this->info.evgen_ovf;
+		}
+	}
+
 	// TODO
 	timer &set_mode(mode_e m) {
 		// TODO
@@ -200,32 +272,71 @@ public:
 		return res;
 	}
 
-	status_e set_compare(std::size_t val, bool enhanced = false) {
-		// TODO 8 32 bit support cc channel
+	// compare/capture channels
+	static const constexpr uint8_t n_channels = 2;
+
+	// NOTE channel 0 is the top in MFRQ mode (see `set_mode`),
+	//	`enhanced` applies to it only
+	status_e set_compare(std::size_t val, bool enhanced = false, uint8_t ch = 0) {
+		// TODO 8 32 bit support
 		auto &t = this->info.tc->COUNT16;
 
 		// range check
-		if (val > this->max_count())
+		if (val > this->max_count() || ch >= n_channels)
 			return status_e::STATUS_INVLARG;
 
 		// enhanced counter handling
 		/* Make sure the count is in a proportional position to where it was
 			to prevent any jitter or disconnect when changing the compare value.
 				- @EHbtj @khoih-prog */
-		if (enhanced) {
+		if (enhanced && ch == 0) {
 			t.COUNT.bit.COUNT = utils::linear_map<std::size_t>(
 				t.COUNT.bit.COUNT, 0,
 				t.CC[0].bit.CC, 0,
 				val
 			);
 		}
-		t.CC[0].bit.CC = val;
+		t.CC[ch].bit.CC = val;
 
 		this->wait_sync();
 
 		return status_e::STATUS_SUCCESS;
 	}
 
+	// 30.6.8 Synchronization: COUNT has to be requested before it is read
+	std::size_t get_count() {
+		auto *t = common_of(this->info.tc);
+		t->READREQ.reg = TC_READREQ_RREQ 
+			| TC_READREQ_ADDR(TC_COUNT16_COUNT_OFFSET);
+		this->wait_sync();
+		return t->COUNT.reg;
+	}
+
+	// NOTE 0 for a channel out of range
+	std::size_t get_compare(uint8_t ch = 0) {
+		if (ch >= n_channels)
+			return 0;
+		return this->info.tc->COUNT16.CC[ch].bit.CC;
+	}
+
+	// NOTE frequency in Hz
+	std::size_t get_tick_freq() {
+		return this->clk->get_freq()
+			/ this->prescaler_info.presets[
+				common_of(this->info.tc)->CTRLA.bit.PRESCALER
+			].val;
+	}
+
+	// time until the next compare match (MC0) in microseconds
+	std::size_t get_time_to_match_us() {
+		std::size_t count = this->get_count();
+		std::size_t top = this->get_compare();
+		std::size_t freq = this->get_tick_freq();
+		if (freq == 0 || count >= top)
+			return 0;
+		return (uint64_t)(top - count) * 1000000 / freq;
+	}
+
 	// interval calc priority setting
 	enum intvlprior_e {
 		INTVLPRIOR_ACC,  // prefer accuracy
@@ -330,7 +441,22 @@ inline vendor_samd::timer tc3({
 	TC3,
 	vendor_samd::clock::devid_e::CLKDEVID_TC3,
 	TC3_IRQn,
-	samd_tc_cb_TC3_mc0
+	samd_tc_cb_TC3_mc0,
+	EVSYS_ID_GEN_TC3_OVF,
+	EVSYS_ID_USER_TC3_EVU,
+	&tinyzero::pms::pm0,
+	vendor_samd::pm::apbc_e::APBC_TC3
+});
+// NOTE shares its generic clock with TC5
+inline vendor_samd::timer tc4({
+	TC4,
+	vendor_samd::clock::devid_e::CLKDEVID_TC4,
+	TC4_IRQn,
+	samd_tc_cb_TC4_mc0,
+	EVSYS_ID_GEN_TC4_OVF,
+	EVSYS_ID_USER_TC4_EVU,
+	&tinyzero::pms::pm0,
+	vendor_samd::pm::apbc_e::APBC_TC4
 });
 }
 }
@@ -112,4 +112,59 @@ inline bool bytes_equal(
 	const char *rhs, std::size_t len_rhs
 ) { return bytes_compare(lhs, len_lhs, rhs, len_rhs) == 0; }
 
+// lock-free single-producer single-consumer ring
+// NOTE e.g. an ISR producing and the main loop consuming, 
+//	each index is written by one side only
+template <typename val_type, std::size_t cap>
+class spsc_ring {
+	static_assert(cap > 0 && (cap & (cap - 1)) == 0, "capacity not a power of 2");
+
+protected:
+	val_type buf[cap];
+	volatile std::size_t head = 0, tail = 0;
+
+public:
+	spsc_ring() {}
+
+	// producer
+	bool push(const val_type &val) {
+		std::size_t h = this->head;
+		if (h - this->tail >= cap)
+			return false;
+		this->buf[h % cap] = val;
+		// NOTE slot contents visible before the index
+		__DMB();
+		this->head = h + 1;
+		return true;
+	}
+
+	// consumer
+	bool pop(val_type &val) {
+		std::size_t t = this->tail;
+		if (t == this->head)
+			return false;
+		__DMB();
+		val = this->buf[t % cap];
+		__DMB();
+		this->tail = t + 1;
+		return true;
+	}
+
+	// consumer, up to `n` at once
+	std::size_t pop(val_type *vals, std::size_t n) {
+		std::size_t t = this->tail;
+		std::size_t len = std::min(n, this->head - t);
+		__DMB();
+		for (std::size_t i = 0; i < len; i++)
+			vals[i] = this->buf[(t + i) % cap];
+		__DMB();
+		this->tail = t + len;
+		return len;
+	}
+
+	std::size_t size() const { return this->head - this->tail; }
+	bool empty() const { return this->size() == 0; }
+	static constexpr std::size_t capacity() { return cap; }
+};
+
 }
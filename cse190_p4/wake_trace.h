@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+
+
+// wake-up source tracer and sleep efficiency statistics
+// NOTE hardware independent: time source and source flags are injected, builds on host as well
+namespace wake_trace {
+class tracer {
+public:
+	// NOTE time in ticks of `tick_freq` Hz, wrapping at `wrap` (0 = 32 bit)
+	//	e.g. the count of a timer that keeps running in standby
+	using clock_fn_t = uint32_t ();
+
+	static const constexpr std::size_t n_sources_max = 8;
+
+	struct stats_s {
+		uint32_t n_wakeups = 0;
+		// no known source pending on wake-up
+		uint32_t n_spurious = 0;
+		// NOTE several sources may be pending on the same wake-up
+		uint32_t n_source[n_sources_max] = {};
+
+		// ticks
+		uint64_t t_asleep = 0, t_awake = 0;
+
+		// permille of time spent awake
+		uint32_t duty_cycle() const {
+			uint64_t total = this->t_asleep + this->t_awake;
+			if (total == 0)
+				return 0;
+			return this->t_awake * 1000 / total;
+		}
+	};
+
+protected:
+	clock_fn_t *clock_f = nullptr;
+	uint32_t tick_freq;
+	uint32_t wrap;
+
+	const char *const *names;
+	std::size_t n_sources;
+
+	uint32_t t_sleep = 0, t_wake = 0;
+	bool has_wake = false;
+
+	struct stats_s stats_ = {};
+
+	uint32_t elapsed(uint32_t t0, uint32_t t1) const {
+		if (this->wrap == 0)
+			return t1 - t0;
+		return (t1 + this->wrap - t0) % this->wrap;
+	}
+
+	uint64_t to_ms(uint64_t ticks) const {
+		if (this->tick_freq == 0)
+			return 0;
+		return ticks * 1000 / this->tick_freq;
+	}
+
+public:
+	// NOTE spans longer than `wrap` ticks alias,
+	//	the wrapping timer is expected to wake the device at least once per period
+	tracer(
+		clock_fn_t *clock_f, uint32_t tick_freq, uint32_t wrap,
+		const char *const *names, std::size_t n_sources
+	) : clock_f(clock_f), tick_freq(tick_freq), wrap(wrap),
+		names(names), n_sources(std::min(n_sources, n_sources_max)) {}
+
+	void sleep_begin() {
+		this->t_sleep = this->clock_f();
+		if (this->has_wake)
+			this->stats_.t_awake += this->elapsed(this->t_wake, this->t_sleep);
+	}
+
+	// bit i of `sources` set if source i was pending on wake-up
+	void sleep_end(uint32_t sources) {
+		this->t_wake = this->clock_f();
+		this->has_wake = true;
+
+		auto &st = this->stats_;
+		st.t_asleep += this->elapsed(this->t_sleep, this->t_wake);
+		st.n_wakeups += 1;
+
+		if (sources == 0) {
+			st.n_spurious += 1;
+			return;
+		}
+		for (std::size_t i = 0; i < this->n_sources; i++)
+			if (sources & (1ul << i))
+				st.n_source[i] += 1;
+	}
+
+	// NOTE not synchronized with tracing, figures may be torn
+	const struct stats_s &stats() const { return this->stats_; }
+
+	void clear() {
+		this->stats_ = {};
+		this->has_wake = false;
+	}
+
+	operator std::string() const {
+		const auto &st = this->stats_;
+		std::string s = std::string("")
+			+ "n = " + std::to_string(st.n_wakeups) + ", "
+			+ "asleep = " + std::to_string(this->to_ms(st.t_asleep)) + "ms, "
+			+ "awake = " + std::to_string(this->to_ms(st.t_awake)) + "ms, "
+			+ "duty = " + std::to_string(st.duty_cycle()) + "permille, "
+			+ "by =";
+		for (std::size_t i = 0; i < this->n_sources; i++)
+			s += std::string(" ") + this->names[i] + ":" + std::to_string(st.n_source[i]);
+		s += " spurious:" + std::to_string(st.n_spurious);
+		return s;
+	}
+};
+}
@@ -0,0 +1,189 @@
+// host harness of accl_trace::encoder/decoder
+// encodes synthetic BMA250 streams (10 bit samples, 64ms data-ready) through the
+//	64 byte buffer of the sketch, decodes them back and checks the round trip,
+//	reports bytes per sample against the raw format, then measures the cost of
+//	encoding one sample
+// NOTE raw format: the 4 byte timestamp and 3 x 2 byte axes of `bma250::sample_s`
+//
+// g++ -std=gnu++17 -O2 -Wall -I../cse190_p4 accl_trace_bench.cpp -o accl_trace_bench
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_RDTSC 1
+#endif
+
+#include "accl_trace.h"
+
+
+namespace {
+const constexpr double
+	sample_hz = 1e6 / 64000,
+	lsb_per_g = 256,
+	pi = 3.14159265358979;
+
+const constexpr std::size_t raw_bytes = 4 + 3 * 2;
+
+// sensor noise, a few LSB
+uint32_t lcg = 1;
+int noise() {
+	lcg = lcg * 1664525u + 1013904223u;
+	return (int)(lcg >> 29) - 4;
+}
+
+int16_t clamp10(double v) {
+	return (int16_t)std::max(-512l, std::min(511l, std::lround(v)));
+}
+
+struct scenario_s {
+	const char *name;
+	// acceleration in LSB at sample `i`, gravity included
+	void (*gen)(std::size_t i, double *x, double *y, double *z);
+	// data-ready ticks between samples, e.g. samples skipped while the bus is busy
+	uint32_t (*dt)(std::size_t i);
+};
+
+uint32_t every_tick(std::size_t) { return 1; }
+
+const scenario_s scenarios[] = {
+	{ "desk",
+		[](std::size_t, double *x, double *y, double *z) {
+			*x = 0; *y = 0; *z = lsb_per_g;
+		}, every_tick },
+	{ "walking",
+		[](std::size_t i, double *x, double *y, double *z) {
+			double t = i / sample_hz;
+			*x = 30 * std::sin(2 * pi * 0.9 * t);
+			*y = 10 * std::sin(2 * pi * 1.8 * t + 1);
+			*z = lsb_per_g + 60 * std::sin(2 * pi * 1.8 * t);
+		}, every_tick },
+	// full scale steps: key frames only
+	{ "shaken",
+		[](std::size_t i, double *x, double *y, double *z) {
+			*x = i % 2 ? 511 : -512;
+			*y = i % 3 ? -300 : 300;
+			*z = lsb_per_g;
+		}, every_tick },
+	// bursts with long gaps in between: varint time deltas
+	{ "bursts",
+		[](std::size_t i, double *x, double *y, double *z) {
+			*x = 5 * (double)(i % 16);
+			*y = 0;
+			*z = lsb_per_g;
+		},
+		[](std::size_t i) -> uint32_t { return i % 16 == 0 ? 20000 : 1; } }
+};
+
+struct capture_s {
+	std::vector<uint8_t> bytes;
+	std::size_t n_flushes = 0;
+};
+
+void sink(const uint8_t *data, std::size_t len, void *capture) {
+	auto *c = (struct capture_s *)capture;
+	assert(len <= accl_trace::encoder::buf_cap);
+	c->bytes.insert(c->bytes.end(), data, data + len);
+	c->n_flushes++;
+}
+
+std::vector<accl_trace::sample_s> generate(const scenario_s &sc, std::size_t n) {
+	std::vector<accl_trace::sample_s> res(n);
+	uint32_t t = 1000;
+	for (std::size_t i = 0; i < n; i++) {
+		double x, y, z;
+		sc.gen(i, &x, &y, &z);
+		t += i > 0 ? sc.dt(i) : 0;
+		// interrupt status on the motion interrupts, here every 50th sample
+		bool has_status = i % 50 == 7;
+		res[i] = {
+			t,
+			clamp10(x + noise()), clamp10(y + noise()), clamp10(z + noise()),
+			has_status, (uint8_t)(has_status ? 0x04 : 0)
+		};
+	}
+	return res;
+}
+
+void round_trip(const scenario_s &sc) {
+	const std::size_t n = 4096;
+	const auto samples = generate(sc, n);
+
+	struct capture_s c;
+	accl_trace::encoder enc(sink, &c);
+	enc.begin(64000);
+	for (const auto &s : samples)
+		enc.push(s.t, s.x, s.y, s.z, s.has_status, s.status);
+	enc.flush();
+
+	const auto &st = enc.stats();
+	assert(st.n_samples == n && st.n_bytes == c.bytes.size());
+	assert(st.n_keys >= n / accl_trace::encoder::key_interval);
+
+	accl_trace::decoder dec(c.bytes.data(), c.bytes.size());
+	assert(dec.valid() && dec.tick_us() == 64000);
+
+	// timestamps decode relative to the first record
+	accl_trace::sample_s s;
+	std::size_t i = 0;
+	while (dec.next(s)) {
+		const auto &e = samples[i];
+		assert(s.t == e.t - samples[0].t);
+		assert(s.x == e.x && s.y == e.y && s.z == e.z);
+		assert(s.has_status == e.has_status && s.status == e.status);
+		i++;
+	}
+	assert(i == n);
+
+	// a truncated stream stops at the last whole record
+	accl_trace::decoder cut(c.bytes.data(), c.bytes.size() - 1);
+	i = 0;
+	while (cut.next(s))
+		i++;
+	assert(i == n - 1);
+
+	double per_sample = (double)(c.bytes.size() - accl_trace::header_len) / n;
+	std::printf("  %-8s %6zu bytes, %4.2f bytes/sample (raw %zu, %3.0f%%), %u keys, %zu writes\n",
+		sc.name, c.bytes.size(), per_sample, raw_bytes, 100 * per_sample / raw_bytes,
+		st.n_keys, c.n_flushes);
+}
+
+// cost of `push` with a sink dropping the bytes
+void cost() {
+	static accl_trace::encoder enc([](const uint8_t *, std::size_t, void *) {});
+	const auto samples = generate(scenarios[1], 4096);
+	const std::size_t n_rounds = 256;
+
+	enc.begin(64000);
+#if defined(HAS_RDTSC)
+	uint64_t t0 = __rdtsc();
+#else
+	auto t0 = std::chrono::steady_clock::now();
+#endif
+	for (std::size_t r = 0; r < n_rounds; r++)
+		for (const auto &s : samples)
+			enc.push(s.t, s.x, s.y, s.z, s.has_status, s.status);
+#if defined(HAS_RDTSC)
+	std::printf("cost: %llu cycles/sample (host)\n",
+		(unsigned long long)((__rdtsc() - t0) / (n_rounds * samples.size())));
+#else
+	std::printf("cost: %lld ns/sample (host)\n",
+		(long long)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - t0).count() / (n_rounds * samples.size())));
+#endif
+}
+}
+
+int main() {
+	std::printf("round trip, 4096 samples\n");
+	for (const auto &sc : scenarios)
+		round_trip(sc);
+	cost();
+	return 0;
+}
@@ -0,0 +1,160 @@
+// host harness of i2c_trace::tracer on an emulated bus
+// replays the BMA250 traffic of the sketch (address probe, 64ms data-ready
+//	burst reads, power policy writes, a stuck bus) against a bus timing model,
+//	checks the aggregates, then measures the cost of tracing one transaction
+// NOTE durations come from the model, not from i2c.h: a change in the traffic
+//	(transaction count, sizes) shows up here, a change in the SERCOM driver does not
+//
+// g++ -std=gnu++17 -O2 -Wall -I../cse190_p4 i2c_trace_bench.cpp -o i2c_trace_bench
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_RDTSC 1
+#endif
+
+#include "i2c_trace.h"
+
+
+namespace {
+// raw `vendor_samd::i2c_status`, i2c.h needs the SAMD headers
+enum status_e : uint8_t {
+	ST_SUCCESS = 0,
+	ST_NACK_ADDR = 2,
+	ST_TIMEOUT = 5
+};
+
+// emulated time, us
+uint32_t t_now = 0;
+uint32_t emulated_clock() { return t_now; }
+
+// 400 kHz: 9 clocks per byte (ACK included), START/STOP and the address byte
+struct bus_s {
+	uint32_t f_scl = 400000;
+	// wait bound of a stuck transaction, see `i2c_common`
+	uint32_t timeout_us = 2000;
+
+	uint32_t duration_us(std::size_t len) const {
+		return (uint32_t)((1 + len) * 9 * 1000000ull / this->f_scl) + 5;
+	}
+};
+
+void transfer(
+	i2c_trace::tracer &tr, const bus_s &bus,
+	uint8_t addr, i2c_trace::dir_e dir, std::size_t len,
+	status_e status = ST_SUCCESS
+) {
+	uint32_t t_start = tr.begin();
+	if (status == ST_TIMEOUT) t_now += bus.timeout_us;
+	else if (status == ST_NACK_ADDR) t_now += bus.duration_us(0);
+	else t_now += bus.duration_us(len);
+	tr.end(t_start, addr, dir, status == ST_SUCCESS ? len : 0,
+		status, status == ST_NACK_ADDR);
+}
+
+// register write: address + value
+void write_reg(i2c_trace::tracer &tr, const bus_s &bus, uint8_t addr) {
+	transfer(tr, bus, addr, i2c_trace::DIR_WRITE, 2);
+}
+
+// data-ready burst: register address, then accl_dataset, temp_data, intt_stat
+void burst_read(i2c_trace::tracer &tr, const bus_s &bus, uint8_t addr) {
+	transfer(tr, bus, addr, i2c_trace::DIR_WRITE, 1);
+	transfer(tr, bus, addr, i2c_trace::DIR_READ, 8);
+}
+
+void scenario(const char *name, const bus_s &bus, bool with_faults) {
+	i2c_trace::tracer tr(emulated_clock);
+	t_now = 1000;
+
+	// sensor strapped to the alternative address
+	transfer(tr, bus, 0x18, i2c_trace::DIR_WRITE, 0, ST_NACK_ADDR);
+	transfer(tr, bus, 0x19, i2c_trace::DIR_WRITE, 0);
+	for (int i = 0; i < 8; i++)
+		write_reg(tr, bus, 0x19);
+
+	// 60 s of streaming, a power policy write on every other 2 s tick
+	const uint32_t t0 = t_now;
+	std::size_t n_bursts = 0;
+	for (uint32_t t = t0; t < t0 + 60000000; t += 64000) {
+		t_now = std::max(t_now, t);
+		burst_read(tr, bus, 0x19);
+		n_bursts++;
+		if ((t - t0) % 4000000 < 64000)
+			write_reg(tr, bus, 0x19);
+		if (with_faults && n_bursts % 100 == 0)
+			transfer(tr, bus, 0x19, i2c_trace::DIR_READ, 8, ST_TIMEOUT);
+	}
+
+	const auto &st = tr.stats();
+	std::printf("%s: %s\n", name, std::string(st).c_str());
+
+	// checks
+	const std::size_t n_faults = with_faults ? n_bursts / 100 : 0;
+	const std::size_t n_ticks = 15;
+	assert(st.n_transactions == 2 + 8 + 2 * n_bursts + n_ticks + n_faults);
+	assert(st.n_nack == 1);
+	assert(st.n_error == n_faults);
+	assert(st.n_bytes == 8 * 2 + 9 * n_bursts + 2 * n_ticks);
+	assert(st.duration_max == (with_faults ? bus.timeout_us : bus.duration_us(8)));
+
+	uint32_t n_hist = 0;
+	for (auto b : st.buckets)
+		n_hist += b;
+	assert(n_hist == st.n_transactions);
+
+	// ~9 bytes per 64ms
+	assert(st.bytes_per_sec() >= 140 && st.bytes_per_sec() <= 145);
+
+	// ring: latest first
+	const auto *r = tr.record(0);
+	assert(r != nullptr && r->addr == 0x19);
+	assert(tr.record(i2c_trace::tracer::ring_cap) == nullptr);
+}
+
+uint32_t host_clock() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()
+	).count();
+}
+
+// cost of `begin` + `end` with a real time source
+void cost() {
+	static i2c_trace::tracer tr(host_clock);
+	const std::size_t n = 1000000;
+
+#if defined(HAS_RDTSC)
+	uint64_t t0 = __rdtsc();
+#else
+	auto t0 = std::chrono::steady_clock::now();
+#endif
+	for (std::size_t i = 0; i < n; i++) {
+		uint32_t t = tr.begin();
+		tr.end(t, 0x19, i2c_trace::DIR_READ, 8, ST_SUCCESS, false);
+	}
+#if defined(HAS_RDTSC)
+	std::printf("cost: %llu cycles/transaction (host)\n",
+		(unsigned long long)((__rdtsc() - t0) / n));
+#else
+	std::printf("cost: %lld ns/transaction (host)\n",
+		(long long)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - t0).count() / n));
+#endif
+}
+}
+
+int main() {
+	bus_s fast, slow;
+	slow.f_scl = 100000;
+
+	scenario("400kHz", fast, false);
+	scenario("100kHz", slow, false);
+	scenario("400kHz, stuck bus", fast, true);
+	cost();
+	return 0;
+}
@@ -0,0 +1,263 @@
+// host benchmark of motion::classifier: accuracy vs cost per window
+// synthetic BMA250 streams (2g range, 256 LSB/g, 15.6 Hz data-ready), one per
+//	situation, labelled with the class and the moving verdict expected;
+//	they go through an accl_trace round trip as well, the replay has to agree
+// recorded traces (see `record_accl` in the sketch) are replayed when given as
+//	arguments, unlabelled: the classes found are reported
+// NOTE costs are host figures, only comparable between window sizes;
+//	the M0+ cost follows the same O(window) loops
+//
+// g++ -std=gnu++17 -O2 -Wall -I../cse190_p4 motion_bench.cpp -o motion_bench
+// ./motion_bench [trace ...]
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <iterator>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_RDTSC 1
+#endif
+
+#include "accl_trace.h"
+#include "motion.h"
+
+
+namespace {
+const constexpr double
+	sample_hz = 1e6 / 64000,
+	lsb_per_g = 256,
+	pi = 3.14159265358979;
+
+struct sample_s {
+	int16_t x, y, z;
+};
+
+struct scenario_s {
+	const char *name;
+	motion::class_e expected;
+	bool moving;
+	// acceleration in LSB at `t` seconds, gravity included
+	void (*gen)(double t, double *x, double *y, double *z);
+};
+
+// sensor noise, a few LSB
+uint32_t lcg = 1;
+double noise() {
+	lcg = lcg * 1664525u + 1013904223u;
+	return (double)(lcg >> 24) / 64 - 2;
+}
+
+const scenario_s scenarios[] = {
+	{ "desk", motion::CLASS_STILL, false,
+		[](double, double *x, double *y, double *z) {
+			*x = 0; *y = 0; *z = lsb_per_g;
+		} },
+	// in-band part of a motor or fan, the rest is filtered by the sensor bandwidth
+	{ "vibrating shelf", motion::CLASS_VIBRATION, false,
+		[](double t, double *x, double *y, double *z) {
+			*x = 6 * std::sin(2 * pi * 6.1 * t);
+			*y = 0;
+			*z = lsb_per_g + 40 * std::sin(2 * pi * 5.3 * t)
+				+ 20 * std::sin(2 * pi * 7.1 * t);
+		} },
+	// lateral shake on top of gravity: the magnitude barely changes
+	{ "lateral square wave", motion::CLASS_CARRIED, true,
+		[](double t, double *x, double *y, double *z) {
+			*x = std::fmod(t, 1.0) < 0.5 ? 300 : -300;
+			*y = 0;
+			*z = lsb_per_g;
+		} },
+	{ "walking", motion::CLASS_CARRIED, true,
+		[](double t, double *x, double *y, double *z) {
+			*x = 30 * std::sin(2 * pi * 0.9 * t);
+			*y = 10 * std::sin(2 * pi * 1.8 * t + 1);
+			*z = lsb_per_g + 60 * std::sin(2 * pi * 1.8 * t);
+		} },
+	// slow tilting in a bag: constant magnitude as well
+	{ "tilting", motion::CLASS_CARRIED, true,
+		[](double t, double *x, double *y, double *z) {
+			double a = pi / 6 * std::sin(2 * pi * 0.2 * t);
+			*x = lsb_per_g * std::sin(a);
+			*y = 0;
+			*z = lsb_per_g * std::cos(a);
+		} },
+	// sway and braking, a little engine vibration
+	{ "vehicle", motion::CLASS_VEHICLE, true,
+		[](double t, double *x, double *y, double *z) {
+			*x = 15 * std::sin(2 * pi * 0.25 * t);
+			*y = 8 * std::sin(2 * pi * 0.4 * t + 2);
+			*z = lsb_per_g + 3 * std::sin(2 * pi * 6.5 * t);
+		} }
+};
+
+std::vector<sample_s> generate(const scenario_s &sc, std::size_t n) {
+	std::vector<sample_s> res(n);
+	for (std::size_t i = 0; i < n; i++) {
+		double x, y, z;
+		sc.gen(i / sample_hz, &x, &y, &z);
+		res[i] = {
+			(int16_t)std::lround(x + noise()),
+			(int16_t)std::lround(y + noise()),
+			(int16_t)std::lround(z + noise())
+		};
+	}
+	return res;
+}
+
+uint64_t now_cycles() {
+#if defined(HAS_RDTSC)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()
+	).count();
+#endif
+}
+
+// samples of a whole trace, up to the first malformed record
+std::vector<sample_s> decode(const std::vector<uint8_t> &bytes) {
+	std::vector<sample_s> res;
+	accl_trace::decoder dec(bytes.data(), bytes.size());
+	accl_trace::sample_s s;
+	while (dec.next(s))
+		res.push_back({ s.x, s.y, s.z });
+	return res;
+}
+
+// encoded as the sketch records it, then decoded
+std::vector<sample_s> round_trip(const std::vector<sample_s> &stream) {
+	std::vector<uint8_t> bytes;
+	accl_trace::encoder enc(
+		[](const uint8_t *data, std::size_t len, void *bytes) {
+			auto *v = (std::vector<uint8_t> *)bytes;
+			v->insert(v->end(), data, data + len);
+		},
+		&bytes
+	);
+	enc.begin(64000);
+	for (std::size_t i = 0; i < stream.size(); i++)
+		enc.push(i, stream[i].x, stream[i].y, stream[i].z);
+	enc.flush();
+	return decode(bytes);
+}
+
+// returns the windows classified as expected
+template <std::size_t window>
+std::size_t run(const std::vector<std::vector<sample_s>> &streams) {
+	std::size_t n_windows = 0, n_class_ok = 0, n_moving_ok = 0;
+	uint64_t cost = 0;
+
+	std::printf("window %zu (%.1f s)\n", window, window / sample_hz);
+	for (std::size_t i = 0; i < std::size(scenarios); i++) {
+		const auto &sc = scenarios[i];
+		motion::classifier<window> clf;
+
+		// pushes only, the classification runs once per window
+		uint64_t t0 = now_cycles();
+		for (const auto &s : streams[i])
+			clf.push(s.x, s.y, s.z);
+		uint64_t t = now_cycles() - t0;
+
+		clf.clear();
+		std::size_t n = 0, n_ok = 0, n_moving = 0;
+		for (const auto &s : streams[i]) {
+			if (!clf.push(s.x, s.y, s.z))
+				continue;
+
+			n++;
+			n_ok += clf.get_class() == sc.expected;
+			n_moving += clf.is_moving() == sc.moving;
+		}
+
+		std::printf("  %-20s class %3zu%%  moving %3zu%%  %s\n",
+			sc.name, 100 * n_ok / n, 100 * n_moving / n,
+			std::string(clf.stats()).c_str());
+		n_windows += n;
+		n_class_ok += n_ok;
+		n_moving_ok += n_moving;
+		cost += t;
+	}
+
+	std::printf("  total: class %zu%%, moving %zu%%, %llu %s/window\n\n",
+		100 * n_class_ok / n_windows, 100 * n_moving_ok / n_windows,
+		(unsigned long long)(cost / n_windows),
+#if defined(HAS_RDTSC)
+		"cycles"
+#else
+		"ns"
+#endif
+	);
+	return n_class_ok;
+}
+
+// classes found in a recorded trace, with the window of the sketch
+void replay(const char *path) {
+	std::FILE *f = std::fopen(path, "rb");
+	if (f == nullptr) {
+		std::printf("%s: cannot open\n", path);
+		return;
+	}
+	std::vector<uint8_t> bytes;
+	uint8_t buf[4096];
+	std::size_t n;
+	while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0)
+		bytes.insert(bytes.end(), buf, buf + n);
+	std::fclose(f);
+
+	accl_trace::decoder dec(bytes.data(), bytes.size());
+	if (!dec.valid()) {
+		std::printf("%s: not an accl_trace stream\n", path);
+		return;
+	}
+	const auto samples = decode(bytes);
+
+	motion::classifier<32> clf;
+	std::size_t n_windows = 0, n_moving = 0;
+	std::size_t n_class[4] = {};
+	for (const auto &s : samples) {
+		if (!clf.push(s.x, s.y, s.z))
+			continue;
+		n_windows++;
+		n_class[clf.get_class()]++;
+		n_moving += clf.is_moving();
+	}
+
+	std::printf("%s: %zu samples (%.1f s), %zu windows\n", path,
+		samples.size(), samples.size() * dec.tick_us() / 1e6, n_windows);
+	if (n_windows == 0)
+		return;
+	for (unsigned c = 0; c < 4; c++)
+		std::printf("  %-10s %3zu%%\n", motion::to_string((motion::class_e)c),
+			100 * n_class[c] / n_windows);
+	std::printf("  moving     %3zu%%\n  %s\n", 100 * n_moving / n_windows,
+		std::string(clf.stats()).c_str());
+}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1) {
+		for (int i = 1; i < argc; i++)
+			replay(argv[i]);
+		return 0;
+	}
+
+	// ~4 min per situation
+	std::vector<std::vector<sample_s>> streams, replayed;
+	for (const auto &sc : scenarios)
+		streams.push_back(generate(sc, 4096));
+	for (const auto &s : streams)
+		replayed.push_back(round_trip(s));
+
+	run<16>(streams);
+	std::size_t n_ok = run<32>(streams);
+	run<64>(streams);
+
+	std::printf("replayed from accl_trace\n");
+	assert(run<32>(replayed) == n_ok);
+	return 0;
+}
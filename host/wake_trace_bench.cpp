@@ -0,0 +1,191 @@
+// host harness of wake_trace::tracer on an emulated RTC
+// replays scripted wake-up sequences of the sketch (2 s tick, BlueNRG events,
+//	BMA250 motion, a spurious wake, lost mode idling on the 1 ms SysTick)
+//	against the 32 kHz RTC timebase, checks the counts, the spurious wakes and
+//	the duty cycle, then measures the cost of tracing one sleep
+// NOTE the sequences are scripted, not measured: a change in the wake-up sources
+//	of the sketch shows up here only once the script follows
+//
+// g++ -std=gnu++17 -O2 -Wall -I../cse190_p4 wake_trace_bench.cpp -o wake_trace_bench
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <iterator>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_RDTSC 1
+#endif
+
+#include "wake_trace.h"
+
+
+namespace {
+// sources, in the order of the sketch
+enum source_e : uint32_t {
+	SRC_TC3 = 1u << 0,
+	SRC_TC4 = 1u << 1,
+	SRC_BLUENRG = 1u << 2,
+	SRC_BMA250 = 1u << 3,
+	SRC_USB = 1u << 4,
+	SRC_SYSTICK = 1u << 5
+};
+
+const char *const names[] = {
+	"tc3", "tc4", "bluenrg", "bma250", "usb", "systick"
+};
+
+const constexpr uint32_t rtc_hz = 32768;
+
+// emulated time, us, and the RTC count it starts from
+uint64_t t_now = 0;
+uint32_t rtc_base = 0;
+uint32_t emulated_rtc() {
+	return rtc_base + (uint32_t)(t_now * rtc_hz / 1000000);
+}
+
+struct wake_s {
+	uint64_t t_us;		// wake-up
+	uint32_t sources;	// 0 for a spurious one
+	uint32_t awake_us;
+};
+
+// sleeps until each wake-up in turn, stays awake for its span
+void replay(wake_trace::tracer &tr, std::vector<struct wake_s> wakes) {
+	std::sort(wakes.begin(), wakes.end(),
+		[](const auto &a, const auto &b) { return a.t_us < b.t_us; });
+	for (const auto &w : wakes) {
+		tr.sleep_begin();
+		t_now = std::max(t_now, w.t_us);
+		tr.sleep_end(w.sources);
+		t_now += w.awake_us;
+	}
+}
+
+// standby between events: 2 s tick, BlueNRG events, a few motion interrupts
+void standby(uint32_t base) {
+	wake_trace::tracer tr(emulated_rtc, rtc_hz, 0, names, std::size(names));
+	t_now = 0;
+	rtc_base = base;
+
+	std::vector<struct wake_s> wakes;
+	std::size_t n_tc3 = 0, n_bluenrg = 0, n_bma250 = 0;
+	uint64_t awake_us = 0;
+	for (uint64_t t = 2000000; t <= 60000000; t += 2000000) {
+		// the tick work: log, power policy writes, BLE stats
+		wakes.push_back({ t, SRC_TC3, 3000 });
+		n_tc3++;
+		awake_us += 3000;
+	}
+	for (uint64_t t = 1300000; t < 60000000; t += 1000000) {
+		wakes.push_back({ t, SRC_BLUENRG, 1000 });
+		n_bluenrg++;
+		awake_us += 1000;
+	}
+	for (uint64_t t : { 7100000, 7700000, 31100000, 45900000, 52300000 }) {
+		wakes.push_back({ t, SRC_BMA250, 10000 });
+		n_bma250++;
+		awake_us += 10000;
+	}
+	// tick and BlueNRG pending on the same wake-up
+	wakes.push_back({ 60500000, SRC_TC3 | SRC_BLUENRG, 3000 });
+	n_tc3++;
+	n_bluenrg++;
+	awake_us += 3000;
+	// nothing pending, e.g. an EIC line not traced
+	wakes.push_back({ 33333000, 0, 500 });
+	awake_us += 500;
+	replay(tr, wakes);
+	// the last span awake is closed by the next sleep
+	tr.sleep_begin();
+
+	const auto &st = tr.stats();
+	std::printf("standby from %08x: %s\n", base, std::string(tr).c_str());
+
+	// checks
+	assert(st.n_wakeups == wakes.size());
+	assert(st.n_spurious == 1);
+	assert(st.n_source[0] == n_tc3);
+	assert(st.n_source[1] == 0);
+	assert(st.n_source[2] == n_bluenrg);
+	assert(st.n_source[3] == n_bma250);
+	assert(st.n_source[4] == 0 && st.n_source[5] == 0);
+
+	// every tick accounted for, the first sleep starts at 0
+	assert(st.t_asleep + st.t_awake == emulated_rtc() - base);
+	// within a tick per span of the script
+	uint64_t awake_ticks = awake_us * rtc_hz / 1000000;
+	assert(st.t_awake + wakes.size() >= awake_ticks
+		&& st.t_awake <= awake_ticks + wakes.size());
+
+	uint32_t duty = (uint32_t)(awake_us * 1000 / t_now);
+	assert(st.duty_cycle() + 1 >= duty && st.duty_cycle() <= duty + 1);
+}
+
+// lost mode: idle between SysTick interrupts, short work on each
+void idle(uint32_t work_us, std::size_t n) {
+	wake_trace::tracer tr(emulated_rtc, rtc_hz, 0, names, std::size(names));
+	t_now = 0;
+	rtc_base = 0;
+
+	std::vector<struct wake_s> wakes;
+	for (std::size_t i = 1; i <= n; i++)
+		wakes.push_back({ i * 1000ull, SRC_SYSTICK, work_us });
+	replay(tr, wakes);
+	tr.sleep_begin();
+
+	const auto &st = tr.stats();
+	std::printf("idle, %uus per 1ms: %s\n", work_us, std::string(tr).c_str());
+
+	// checks
+	assert(st.n_wakeups == n && st.n_spurious == 0);
+	assert(st.n_source[5] == n);
+	// a 30.5us tick resolves the duty cycle within a few permille
+	uint32_t duty = work_us;
+	assert(st.duty_cycle() + 5 >= duty && st.duty_cycle() <= duty + 5);
+}
+
+uint32_t host_clock() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()
+	).count();
+}
+
+// cost of `sleep_begin` + `sleep_end` with a real time source
+void cost() {
+	static wake_trace::tracer tr(host_clock, 1000000, 0, names, std::size(names));
+	const std::size_t n = 1000000;
+
+#if defined(HAS_RDTSC)
+	uint64_t t0 = __rdtsc();
+#else
+	auto t0 = std::chrono::steady_clock::now();
+#endif
+	for (std::size_t i = 0; i < n; i++) {
+		tr.sleep_begin();
+		tr.sleep_end(SRC_TC3);
+	}
+#if defined(HAS_RDTSC)
+	std::printf("cost: %llu cycles/sleep (host)\n",
+		(unsigned long long)((__rdtsc() - t0) / n));
+#else
+	std::printf("cost: %lld ns/sleep (host)\n",
+		(long long)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - t0).count() / n));
+#endif
+}
+}
+
+int main() {
+	standby(0);
+	// the 32 bit count wraps after 36 hours
+	standby(0xFFFFFFFFu - 1000000);
+	idle(20, 1000);
+	idle(100, 1000);
+	cost();
+	return 0;
+}